@@ -10,6 +10,7 @@
  *
  */
 
+#include <stdbool.h>
 #include <stdint.h>
 #include "nrf.h"
 #include "nrf_log.h"
@@ -19,18 +20,65 @@
 #include "boards.h"
 #include "app_timer.h"
 #include "nrf_drv_clock.h"
+#include "SEGGER_RTT.h"
 #include "nrf_capsense.h"
 #include "nrf_capsense_cfg.h"
+#include "nrf_capsense_telemetry.h"
+#include "nrf_resource.h"
 
 
 // Capsense configuration
-#define CAPSENSE_INTERVAL_MS            10
+#define CAPSENSE_IDLE_TIMEOUT_MS        5000  // Return to low power profile after this long without a press.
+#define CAPSENSE_REFERENCE_DELTA        10    // Expected half period shift of a touch, for the self-test SNR.
+#define CAPSENSE_TELEMETRY_RTT_CHANNEL  1     // RTT up channel for binary telemetry (channel 0 is the log).
+#define CAPSENSE_TELEMETRY_RTT_SIZE     512   // RTT up buffer size for telemetry.
 
 // General application timer settings.
 #define APP_TIMER_PRESCALER             16    // RTC PRESCALER register value.
-#define APP_TIMER_OP_QUEUE_SIZE         2     // Size of timer operation queues.
+#define APP_TIMER_OP_QUEUE_SIZE         4     // Size of timer operation queues.
 
 APP_TIMER_DEF(m_capsense_timer);
+APP_TIMER_DEF(m_idle_timer);
+
+
+// Capsense operating profile. A profile selects the scan interval, the
+// kind of scan and the library tuning.
+typedef struct
+{
+    uint32_t interval_ms;                 // Scan interval
+    bool proximity;                       // Proximity scan instead of button scan
+    nrf_capsense_tuning_t tuning;         // Library tuning
+} capsense_profile_t;
+
+// Low power profile, used while waiting for the user to approach.
+static const capsense_profile_t m_low_power_profile = {
+    100,
+    true,
+    {
+        CAPSENSE_CALIBRATION_FILTER_MARGIN,
+        CAPSENSE_DEBOUNCE_CONFIDENCE_THRESHOLD,
+        0x03,
+        CAPSENSE_PROXIMITY_THRESHOLD
+    }
+};
+
+// High responsiveness profile, used while the user interacts.
+static const capsense_profile_t m_responsive_profile = {
+    10,
+    false,
+    {
+        CAPSENSE_CALIBRATION_FILTER_MARGIN,
+        3,
+        0x03,
+        CAPSENSE_PROXIMITY_THRESHOLD
+    }
+};
+
+static const capsense_profile_t *m_profile = &m_low_power_profile;
+
+static nrf_capsense_selftest_report_t m_selftest_report;
+
+static uint8_t m_telemetry_rtt_buffer[CAPSENSE_TELEMETRY_RTT_SIZE];
 
 
 static void nrf_log_init(void)
@@ -81,28 +129,114 @@ static void update_leds(uint32_t pin_mask)
 }
 
 
-static void capsense_timer_start()
+static void capsense_profile_apply(const capsense_profile_t *profile)
 {
-    uint32_t err_code = app_timer_start(m_capsense_timer,
-                                        APP_TIMER_TICKS(CAPSENSE_INTERVAL_MS, APP_TIMER_PRESCALER),
-                                        NULL);
+    // The tuning takes effect from the next scan. Calibration is kept.
+    uint32_t err_code = app_timer_stop(m_capsense_timer);
+    APP_ERROR_CHECK(err_code);
+
+    if (m_profile->proximity && !profile->proximity)
+    {
+        // Leaving proximity scanning. Start from a fresh baseline and
+        // state when coming back to it.
+        nrf_capsense_proximity_reset();
+    }
+    m_profile = profile;
+    err_code = nrf_capsense_tuning_set(&profile->tuning);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = app_timer_start(m_capsense_timer,
+                               APP_TIMER_TICKS(profile->interval_ms, APP_TIMER_PRESCALER),
+                               NULL);
+    APP_ERROR_CHECK(err_code);
+}
+
+
+static void idle_timer_restart()
+{
+    uint32_t err_code = app_timer_stop(m_idle_timer);
+    APP_ERROR_CHECK(err_code);
+    err_code = app_timer_start(m_idle_timer,
+                               APP_TIMER_TICKS(CAPSENSE_IDLE_TIMEOUT_MS, APP_TIMER_PRESCALER),
+                               NULL);
     APP_ERROR_CHECK(err_code);
 }
 
 
+#if CAPSENSE_TIMESTAMP_ENABLED
+static void log_button_timing()
+{
+    // Ticks of the app_timer RTC (APP_TIMER_PRESCALER)
+    nrf_capsense_event_info_t info;
+
+    nrf_capsense_event_info_get(&info);
+    for (unsigned int i = 0; i < CAPSENSE_NUM_BUTTONS; i++)
+    {
+        if (info.changed_mask & (1 << i))
+        {
+            NRF_LOG_PRINTF("Capsense channel %u: onset %u, latency %u, duration %u ticks\r\n",
+                           i,
+                           info.channel[i].onset_ticks,
+                           (info.decision_ticks - info.channel[i].onset_ticks) & 0x00FFFFFF,
+                           info.channel[i].duration_ticks);
+        }
+    }
+}
+#endif
+
+
 static void capsense_button_event_handler(enum capsense_event_t event, uint32_t pin_mask)
 {
+    uint32_t err_code;
+
     switch (event)
     {
     case CAPSENSE_BUTTON_EVENT:
         NRF_LOG_PRINTF("Capsense button mask update: %u\r\n", pin_mask);
+#if CAPSENSE_TIMESTAMP_ENABLED
+        log_button_timing();
+#endif
         update_leds(pin_mask);
+        idle_timer_restart();
         break;
 
     case CAPSENSE_CALIBRATION_EVENT:
         NRF_LOG("Capsense calibration done\r\n");
-        // Start capsense timer to sample buttons regularly.
-        capsense_timer_start();
+        // Wait for the user to approach before sampling buttons.
+        capsense_profile_apply(&m_low_power_profile);
+        break;
+
+    case CAPSENSE_PROXIMITY_EVENT:
+        NRF_LOG_PRINTF("Capsense proximity: %u\r\n", pin_mask);
+        if (pin_mask)
+        {
+            // Approach detected. Sample buttons regularly until no
+            // button has been pressed for a while.
+            capsense_profile_apply(&m_responsive_profile);
+            idle_timer_restart();
+        }
+        break;
+
+    case CAPSENSE_MOISTURE_EVENT:
+        NRF_LOG_PRINTF("Capsense moisture: %u\r\n", pin_mask);
+        break;
+
+    case CAPSENSE_SELFTEST_EVENT:
+        for (unsigned int i = 0; i < CAPSENSE_NUM_BUTTONS; i++)
+        {
+            NRF_LOG_PRINTF("Capsense self-test channel %u: baseline %u, noise %u/16, SNR %u/16, status %u\r\n",
+                           i,
+                           m_selftest_report.channel[i].baseline,
+                           m_selftest_report.channel[i].noise_q4,
+                           m_selftest_report.channel[i].snr_q4,
+                           m_selftest_report.channel[i].status);
+        }
+        if (pin_mask)
+        {
+            NRF_LOG_ERROR("Capsense self-test failed\r\n");
+        }
+        err_code = nrf_capsense_calibrate();
+        APP_ERROR_CHECK(err_code);
         break;
 
     case CAPSENSE_TIMEOUT_EVENT:
@@ -116,16 +250,37 @@ static void init_capsense()
 {
     static nrf_capsense_cfg_t cfg = {
         {2, 3},                         // Analog input pins (AIN).
-        capsense_button_event_handler   // Callback function
+        capsense_button_event_handler,  // Callback function
+        0x03,                           // Both pins form the proximity electrode
+        nrf_capsense_telemetry_scan_handler, // Raw samples to telemetry
+        0,                              // No classifier
+        CAPSENSE_DEFAULT_RESOURCES      // TIMER1, PPI channels 0-2, priority 3
     };
 
-    nrf_capsense_init(&cfg);
+    nrf_capsense_telemetry_init();
+    uint32_t err_code = nrf_capsense_init(&cfg);
+    APP_ERROR_CHECK(err_code);
 }
 
 
 static void capsense_timer_event_handler(void * p_context)
 {
-    nrf_capsense_sample();
+    if (m_profile->proximity)
+    {
+        uint32_t err_code = nrf_capsense_proximity_sample();
+        APP_ERROR_CHECK(err_code);
+    }
+    else
+    {
+        nrf_capsense_sample();
+    }
+}
+
+
+static void idle_timer_event_handler(void * p_context)
+{
+    update_leds(0);
+    capsense_profile_apply(&m_low_power_profile);
 }
 
 
@@ -138,12 +293,49 @@ static void init_leds()
 
 static void init_timer()
 {
+    // app_timer does not use the resource registry. Claim its RTC so
+    // that no driver is configured to use it.
+    uint32_t err_code = nrf_resource_claim(NRF_RESOURCE_RTC, 1, "app_timer");
+    APP_ERROR_CHECK(err_code);
+
     APP_TIMER_INIT(APP_TIMER_PRESCALER, APP_TIMER_OP_QUEUE_SIZE, false);
 
-    uint32_t err_code = app_timer_create(&m_capsense_timer,
+    err_code = app_timer_create(&m_capsense_timer,
                                          APP_TIMER_MODE_REPEATED,
                                          capsense_timer_event_handler);
     APP_ERROR_CHECK(err_code);
+
+    err_code = app_timer_create(&m_idle_timer,
+                                APP_TIMER_MODE_SINGLE_SHOT,
+                                idle_timer_event_handler);
+    APP_ERROR_CHECK(err_code);
+}
+
+
+static void init_telemetry()
+{
+    // Telemetry is written to a separate RTT channel, so that it can
+    // be captured to file with e.g. JLinkRTTLogger and decoded with
+    // tools/telemetry/decode.
+    SEGGER_RTT_ConfigUpBuffer(CAPSENSE_TELEMETRY_RTT_CHANNEL,
+                              "Capsense",
+                              m_telemetry_rtt_buffer,
+                              sizeof(m_telemetry_rtt_buffer),
+                              SEGGER_RTT_MODE_NO_BLOCK_SKIP);
+}
+
+
+static void flush_telemetry()
+{
+    // Move encoded frames from the capsense scan handler to RTT in
+    // thread context, so the sampling interrupt only encodes.
+    uint8_t buf[64];
+    uint32_t length;
+
+    while ((length = nrf_capsense_telemetry_read(buf, sizeof(buf))) > 0)
+    {
+        SEGGER_RTT_Write(CAPSENSE_TELEMETRY_RTT_CHANNEL, buf, length);
+    }
 }
 
 
@@ -164,11 +356,15 @@ int main(void)
     nrf_log_init();
     init_timer();
     init_leds();
+    init_telemetry();
     init_capsense();
-    nrf_capsense_calibrate();
+    // Calibration is started once the self-test completes
+    uint32_t err_code = nrf_capsense_selftest(&m_selftest_report, CAPSENSE_REFERENCE_DELTA);
+    APP_ERROR_CHECK(err_code);
 
     while (true)
     {
+        flush_telemetry();
         power_down();
     }
 }
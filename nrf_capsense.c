@@ -13,8 +13,19 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include "nrf.h"
+#include "nrf_error.h"
 #include "nrf_capsense.h"
 #include "nrf_capsense_cfg.h"
+#include "nrf_resource.h"
+
+#if CAPSENSE_FIXED_SLOT_ENABLED && CAPSENSE_PARTIAL_SCAN_ENABLED
+#error "Fixed slot mode requires every channel to be sampled every scan"
+#endif
+
+#define RTC_COUNTER_MASK                0x00FFFFFF
+#define TIMER_TICKS_PER_RTC_TICK        488     // 16 MHz / 32768 Hz
+#define TIMER_TIMEOUT_TICKS             (1000*16)
+#define IRQ_PRIORITY_COUNT              (1 << __NVIC_PRIO_BITS)
 
 
 typedef struct
@@ -22,44 +33,289 @@ typedef struct
     uint32_t cal_val_min;
     uint32_t cal_val_max;
     uint32_t cal_average;
+    int32_t comp_offset;          // Environment correction of cal_average
+#if CAPSENSE_COMPENSATION_ENABLED
+    uint32_t prev_cal_average;    // cal_average of the previous calibration, 0 if none
+    int32_t temp_coeff_q8;        // Counts x 256 per 0.25 degC
+    int32_t vdd_coeff_q8;         // Counts x 256 per SAADC LSB
+#endif
 } calibration_data_t;
 
 
+typedef struct
+{
+    uint8_t isource;              // COMP_ISOURCE_ISOURCE_*
+    uint8_t th_down;              // THDOWN, VDD / 64 steps
+    uint8_t th_up;                // THUP, VDD / 64 steps
+    uint8_t speed;                // COMP_MODE_SP_*
+} comp_setting_t;
+
+
+// Candidate comparator settings. The first entry is the fixed setting
+// used when auto-select is disabled. A lower current or a wider
+// threshold window gives a longer half period (more counts).
+static const comp_setting_t m_comp_settings[] =
+{
+    {COMP_ISOURCE_ISOURCE_Ien10mA, 5, 60, COMP_MODE_SP_High},
+    {COMP_ISOURCE_ISOURCE_Ien10mA, 2, 62, COMP_MODE_SP_High},
+    {COMP_ISOURCE_ISOURCE_Ien5mA,  5, 60, COMP_MODE_SP_High},
+    {COMP_ISOURCE_ISOURCE_Ien5mA,  2, 62, COMP_MODE_SP_Normal},
+    {COMP_ISOURCE_ISOURCE_Ien2mA5, 5, 60, COMP_MODE_SP_Normal},
+    {COMP_ISOURCE_ISOURCE_Ien2mA5, 2, 62, COMP_MODE_SP_Low},
+};
+
+#define COMP_SETTING_COUNT (sizeof(m_comp_settings) / sizeof(m_comp_settings[0]))
+
+
+#if CAPSENSE_COMPENSATION_ENABLED
+typedef struct
+{
+    int32_t temp;                 // Die temperature, 0.25 degC
+    int32_t vdd;                  // Supply, SAADC LSB (3.6 V / 1024)
+} environment_t;
+
+
+// Progress of the asynchronous environment measurement
+typedef enum
+{
+    ENVIRONMENT_IDLE,
+    ENVIRONMENT_STARTING,         // SAADC started, TEMP converting
+    ENVIRONMENT_CONVERTING,       // SAADC sampling
+    ENVIRONMENT_STOPPING          // Result read, SAADC stopping
+} environment_state_t;
+#endif
+
+
 static calibration_data_t m_calibration_data[CAPSENSE_NUM_BUTTONS];
 static uint32_t m_current_pin_index = 0;
 static nrf_capsense_cfg_t *m_cfg = 0;
+static nrf_capsense_resources_t m_resources;     // Copy of m_cfg->resources
+static NRF_TIMER_Type *m_timer = 0;
+static uint32_t m_timer_index = 0;
+static const char m_resource_owner[] = "capsense";   // Resource registry owner
 static uint32_t m_pressed_mask = 0;
 static bool m_calibration_active = false;
 static uint32_t m_calibration_run = 0;
 static uint32_t m_debounced_pin_mask = 0;
 static uint32_t m_debounce_pressed_confidence_level[CAPSENSE_NUM_BUTTONS] = {0};
 static uint32_t m_debounce_released_confidence_level[CAPSENSE_NUM_BUTTONS] = {0};
+static bool m_proximity_active = false;
+static bool m_proximity_detected = false;
+static uint32_t m_proximity_period = 0;
+static uint32_t m_proximity_sum = 0;
+static uint32_t m_proximity_baseline_acc = 0;   // Baseline scaled by 2^CAPSENSE_PROXIMITY_BASELINE_SHIFT
+static uint32_t m_proximity_detected_scans = 0; // Consecutive scans with an approach detected
+static uint32_t m_sample[CAPSENSE_NUM_BUTTONS];
+static int32_t m_sample_delta[CAPSENSE_NUM_BUTTONS];
+static nrf_capsense_tuning_t m_tuning = {
+    CAPSENSE_CALIBRATION_FILTER_MARGIN,
+    CAPSENSE_DEBOUNCE_CONFIDENCE_THRESHOLD,
+    (1UL << CAPSENSE_NUM_BUTTONS) - 1,
+    CAPSENSE_PROXIMITY_THRESHOLD
+};
+static nrf_capsense_tuning_t m_pending_tuning;
+static volatile bool m_tuning_pending = false;
+static uint32_t m_scan_mask = 0;
+#if CAPSENSE_TIMESTAMP_ENABLED
+static uint32_t m_sample_ticks[CAPSENSE_NUM_BUTTONS];       // Time of the latest sample
+static uint32_t m_run_onset_ticks[CAPSENSE_NUM_BUTTONS];    // First sample of the current run
+static uint32_t m_press_onset_ticks[CAPSENSE_NUM_BUTTONS];  // Onset of the latest press
+static nrf_capsense_event_info_t m_event_info;
+#endif
+static nrf_capsense_features_t m_features;
+static uint32_t m_feature_energy[CAPSENSE_NUM_BUTTONS];  // Q12, unsaturated
+static bool m_selftest_active = false;
+static nrf_capsense_selftest_report_t *m_selftest_report = 0;
+static uint32_t m_selftest_reference_delta = 0;
+static uint32_t m_selftest_period = 0;
+static uint32_t m_selftest_sample = 0;
+static uint32_t m_selftest_acc = 0;
+static uint32_t m_selftest_sum = 0;
+static uint64_t m_selftest_sum_sq = 0;
+static uint32_t m_selftest_fail_mask = 0;
+#if CAPSENSE_FIXED_SLOT_ENABLED
+static bool m_fixed_slot_active = false;
+static uint32_t m_fixed_slot_period = 0;
+static uint32_t m_fixed_slot_scan_start = 0;  // RTC tick of the current scan start
+#endif
+static uint32_t m_comp_setting_applied = 0;   // Entry of m_comp_settings in COMP
+#if CAPSENSE_COMP_AUTOSELECT_ENABLED
+static uint8_t m_comp_setting[CAPSENSE_NUM_BUTTONS] = {0};
+static bool m_comp_sweep_active = false;
+static uint32_t m_comp_sweep_candidate = 0;
+static uint32_t m_comp_sweep_sample = 0;
+static uint32_t m_comp_sweep_acc = 0;
+static uint32_t m_comp_sweep_best = 0;
+static uint32_t m_comp_sweep_best_counts = 0;
+#endif
+#if CAPSENSE_COMPENSATION_ENABLED
+static environment_t m_cal_environment;       // At the latest calibration
+static environment_t m_prev_cal_environment;  // At the calibration before that
+static bool m_cal_environment_valid = false;
+static bool m_cal_environment_pending = false; // Calibrated, environment not yet measured
+static bool m_environment_for_calibration = false; // Measurement in progress was started after calibrating
+static uint32_t m_compensation_scan = 0;
+static environment_state_t m_environment_state = ENVIRONMENT_IDLE;
+static volatile int16_t m_saadc_result;       // SAADC EasyDMA buffer
+#endif
+#if CAPSENSE_PARTIAL_SCAN_ENABLED
+static uint32_t m_round_robin_index = 0;
+#endif
+#if CAPSENSE_MOISTURE_REJECTION_ENABLED
+static bool m_moisture_detected = false;
+static uint32_t m_moisture_dry_scans = 0;
+static int32_t m_moisture_prev_delta[CAPSENSE_NUM_BUTTONS];
+static uint32_t m_moisture_prev_scan_mask = 0;      // Channels m_moisture_prev_delta is from
+static uint32_t m_moisture_touch_onset_mask = 0;    // Shifted channels that rose like a touch
+#endif
 
 
 static void post_sampling_cleanup()
 {
 #if CAPSENSE_ALWAYS_CONSTANT_LATENCY == 0
+#if CAPSENSE_FIXED_SLOT_ENABLED
+    if (m_fixed_slot_active)
+    {
+        // Keep the clock ready for the next PPI started scan
+        return;
+    }
+#endif
     NRF_POWER->TASKS_CONSTLAT = 0;
 #endif
 }
 
 
+// Return the index of the first pin in mask starting at (and
+// including) index, or CAPSENSE_NUM_BUTTONS if there is none.
+static uint32_t next_pin_index(uint32_t mask, uint32_t index)
+{
+    while ((index < CAPSENSE_NUM_BUTTONS) && ((mask & (1 << index)) == 0))
+    {
+        index++;
+    }
+
+    return index;
+}
+
+
+static void tuning_apply_pending()
+{
+    // Called when no scan is ongoing. Interrupts are disabled while
+    // copying so that a concurrent nrf_capsense_tuning_set() cannot
+    // leave a partially updated tuning.
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (m_tuning_pending)
+    {
+        m_tuning = m_pending_tuning;
+        m_tuning_pending = false;
+    }
+    __set_PRIMASK(primask);
+}
+
+
+static void comp_setting_apply(uint32_t index)
+{
+    // Reconfigure with the comparator disabled
+    NRF_COMP->ENABLE = (COMP_ENABLE_ENABLE_Disabled << COMP_ENABLE_ENABLE_Pos);
+    NRF_COMP->TH = (m_comp_settings[index].th_down << COMP_TH_THDOWN_Pos) |
+                   (m_comp_settings[index].th_up << COMP_TH_THUP_Pos);
+    NRF_COMP->MODE = (COMP_MODE_MAIN_SE << COMP_MODE_MAIN_Pos) |
+                     (m_comp_settings[index].speed << COMP_MODE_SP_Pos);
+    NRF_COMP->ISOURCE = (m_comp_settings[index].isource << COMP_ISOURCE_ISOURCE_Pos);
+    m_comp_setting_applied = index;
+}
+
+
+#if CAPSENSE_FIXED_SLOT_ENABLED
+// Arm the RTC to start the measurement of the current pin at the
+// beginning of its slot. Return false if the slot start is too close,
+// or already passed, to be caught by the RTC.
+static bool fixed_slot_arm(void)
+{
+    uint32_t slot_start = (m_fixed_slot_scan_start + m_current_pin_index * CAPSENSE_FIXED_SLOT_TICKS) &
+                          RTC_COUNTER_MASK;
+    uint32_t ahead = (slot_start - CAPSENSE_RTC->COUNTER) & RTC_COUNTER_MASK;
+
+    CAPSENSE_RTC->EVENTS_COMPARE[0] = 0;
+    CAPSENSE_RTC->CC[0] = slot_start;
+
+    // The RTC needs the compare value to be at least two ticks ahead
+    return (ahead >= 2) && (ahead < (RTC_COUNTER_MASK / 2));
+}
+#endif
+
+
+// Return the half period of the latest button measurement
+static uint32_t sample_half_period(void)
+{
+#if CAPSENSE_FIXED_SLOT_ENABLED
+    if (m_fixed_slot_active)
+    {
+        // The timer runs from the slot start, so that the timeout is
+        // counted from there. The upward crossing is captured to CC[2]
+        // instead of clearing the timer.
+        return m_timer->CC[0] - m_timer->CC[2];
+    }
+#endif
+    return m_timer->CC[0];
+}
+
+
 static void sample_initiate()
 {
-    // Clear timer
-    CAPSENSE_TIMER->TASKS_CLEAR = 1;
+    // Clear the timer. It is started here so that the timeout also
+    // triggers if the oscillator never starts, and cleared again by
+    // PPI at the upward crossing.
+    m_timer->TASKS_CLEAR = 1;
+
+#if CAPSENSE_COMP_AUTOSELECT_ENABLED
+    uint32_t setting = m_comp_sweep_active ? m_comp_sweep_candidate : m_comp_setting[m_current_pin_index];
+
+    // Only reconfigure when the setting changes, which needs the
+    // comparator disabled
+    if (setting != m_comp_setting_applied)
+    {
+        comp_setting_apply(setting);
+    }
+#endif
 
     // Set COMP pin and enable the COMP
     NRF_COMP->PSEL = m_cfg->analog_pins[m_current_pin_index];
     NRF_COMP->ENABLE = (COMP_ENABLE_ENABLE_Enabled << COMP_ENABLE_ENABLE_Pos);
+#if CAPSENSE_GUARD_ENABLED
+    // Drive guard high while the electrode charges. It is pulled low
+    // by PPI on the upward crossing.
+    NRF_GPIOTE->TASKS_SET[CAPSENSE_GUARD_GPIOTE_CH] = 1;
+#endif
+#if CAPSENSE_FIXED_SLOT_ENABLED
+    if (m_fixed_slot_active && fixed_slot_arm())
+    {
+        // Timer and COMP are started together by PPI at the slot start
+        return;
+    }
+    // Otherwise the slot is missed. Start at once rather than stall
+    // until the RTC wraps; this scan is late, the next is on time.
+#endif
+    m_timer->TASKS_START = 1;
     NRF_COMP->TASKS_START = 1;
 }
 
 
+// Return the expected sample of an untouched channel
+static uint32_t channel_baseline(uint32_t pin_index)
+{
+    int32_t baseline = (int32_t)m_calibration_data[pin_index].cal_average +
+                       m_calibration_data[pin_index].comp_offset;
+
+    return (baseline > 0) ? (uint32_t)baseline : 0;
+}
+
+
 // Return true if button is pressed
-static bool analyze_sample(uint32_t sample)
+static bool analyze_sample(uint32_t sample, uint32_t pin_index)
 {
-    if (sample > (m_calibration_data[m_current_pin_index].cal_average + CAPSENSE_CALIBRATION_FILTER_MARGIN))
+    if (sample > (channel_baseline(pin_index) + m_tuning.filter_margin))
     {
         return true;
     }
@@ -70,19 +326,70 @@ static bool analyze_sample(uint32_t sample)
 }
 
 
+#if CAPSENSE_TIMESTAMP_ENABLED
+static uint32_t timestamp(void)
+{
+    return CAPSENSE_TIMESTAMP_RTC->COUNTER;
+}
+
+
+static void event_info_update(uint32_t changed_mask)
+{
+    m_event_info.decision_ticks = timestamp();
+    m_event_info.changed_mask = changed_mask;
+
+    for (unsigned int i = 0; i < CAPSENSE_NUM_BUTTONS; i++)
+    {
+        if ((changed_mask & (1 << i)) == 0)
+        {
+            continue;
+        }
+
+        m_event_info.channel[i].onset_ticks = m_run_onset_ticks[i];
+        if (m_debounced_pin_mask & (1 << i))
+        {
+            m_press_onset_ticks[i] = m_run_onset_ticks[i];
+            m_event_info.channel[i].duration_ticks = 0;
+        }
+        else
+        {
+            m_event_info.channel[i].duration_ticks = (m_run_onset_ticks[i] - m_press_onset_ticks[i]) & RTC_COUNTER_MASK;
+        }
+    }
+}
+#endif
+
+
 static void debounce(uint32_t pin_mask)
 {
     uint32_t prev_debounced_pin_mask = m_debounced_pin_mask;
+    // Enabled channels that were not sampled in this scan keep their
+    // state. Disabled channels are treated as released.
+    uint32_t skip_mask = m_tuning.channel_mask & ~m_scan_mask;
 
     for (unsigned int i = 0; i < CAPSENSE_NUM_BUTTONS; i++)
     {
+        if (skip_mask & (1 << i))
+        {
+            continue;
+        }
+
         bool pressed = (pin_mask & (1 << i)) > 0 ? true : false;
 
+#if CAPSENSE_TIMESTAMP_ENABLED
+        if ((pressed && (m_debounce_pressed_confidence_level[i] == 0)) ||
+            (!pressed && (m_debounce_released_confidence_level[i] == 0)))
+        {
+            // First sample of a run
+            m_run_onset_ticks[i] = m_sample_ticks[i];
+        }
+#endif
+
         if (pressed)
         {
             m_debounce_pressed_confidence_level[i]++;
             m_debounce_released_confidence_level[i] = 0;
-            if (m_debounce_pressed_confidence_level[i] > CAPSENSE_DEBOUNCE_CONFIDENCE_THRESHOLD)
+            if (m_debounce_pressed_confidence_level[i] > m_tuning.debounce_threshold)
             {
                 m_debounced_pin_mask |= (1 << i); // Tag button as pressed
                 m_debounce_pressed_confidence_level[i] = 0;
@@ -92,7 +399,7 @@ static void debounce(uint32_t pin_mask)
         {
             m_debounce_released_confidence_level[i]++;
             m_debounce_pressed_confidence_level[i] = 0;
-            if (m_debounce_released_confidence_level[i] > CAPSENSE_DEBOUNCE_CONFIDENCE_THRESHOLD)
+            if (m_debounce_released_confidence_level[i] > m_tuning.debounce_threshold)
             {
                 m_debounced_pin_mask &= ~(1 << i); // Tag button as released
                 m_debounce_released_confidence_level[i] = 0;
@@ -104,34 +411,665 @@ static void debounce(uint32_t pin_mask)
     {
         // Change in button press state. Callback.
         post_sampling_cleanup();
+#if CAPSENSE_TIMESTAMP_ENABLED
+        event_info_update(prev_debounced_pin_mask ^ m_debounced_pin_mask);
+#endif
         m_cfg->callback(CAPSENSE_BUTTON_EVENT, m_debounced_pin_mask);
     }
 }
 
 
+#if CAPSENSE_MOISTURE_REJECTION_ENABLED
+// Return true if the panel is considered wet, in which case the
+// samples of this scan must not be used for button detection.
+static bool moisture_detect(void)
+{
+    uint32_t shifted_channels = 0;
+    int32_t min_delta = INT32_MAX;
+    int32_t max_delta = INT32_MIN;
+    bool prev_moisture_detected = m_moisture_detected;
+
+    for (unsigned int i = 0; i < CAPSENSE_NUM_BUTTONS; i++)
+    {
+        if ((m_scan_mask & (1 << i)) == 0)
+        {
+            continue;
+        }
+
+        bool shifted = m_sample_delta[i] > (int32_t)m_tuning.filter_margin;
+
+        if (!shifted)
+        {
+            m_moisture_touch_onset_mask &= ~(1 << i);
+        }
+        else if (((m_moisture_prev_scan_mask & (1 << i)) != 0) &&
+                 (m_moisture_prev_delta[i] <= (int32_t)m_tuning.filter_margin) &&
+                 ((m_sample_delta[i] - m_moisture_prev_delta[i]) > CAPSENSE_MOISTURE_MAX_ONSET_STEP))
+        {
+            // A finger lands within a scan or two, whereas a film
+            // builds up slowly. The step is only compared with the
+            // previous scan; with partial scan, a channel left out of
+            // it would add up the drift of several scans.
+            m_moisture_touch_onset_mask |= 1 << i;
+        }
+        m_moisture_prev_delta[i] = m_sample_delta[i];
+
+        if (shifted)
+        {
+            shifted_channels++;
+            if (m_sample_delta[i] < min_delta)
+            {
+                min_delta = m_sample_delta[i];
+            }
+            if (m_sample_delta[i] > max_delta)
+            {
+                max_delta = m_sample_delta[i];
+            }
+        }
+    }
+    m_moisture_prev_scan_mask = m_scan_mask;
+
+    if (m_scan_mask != m_tuning.channel_mask)
+    {
+        // Partial scan. Only a full scan can show the signature, so
+        // keep the current state.
+        return m_moisture_detected;
+    }
+
+    if ((shifted_channels >= CAPSENSE_MOISTURE_MIN_CHANNELS) &&
+        ((max_delta - min_delta) <= CAPSENSE_MOISTURE_MAX_SPREAD) &&
+        ((m_moisture_touch_onset_mask & m_scan_mask) == 0))
+    {
+        // All channels moved together. Water film signature.
+        m_moisture_detected = true;
+        m_moisture_dry_scans = 0;
+    }
+    else if (m_moisture_detected)
+    {
+        m_moisture_dry_scans++;
+        if (m_moisture_dry_scans >= CAPSENSE_MOISTURE_DRY_SCANS)
+        {
+            m_moisture_detected = false;
+        }
+    }
+
+    if (prev_moisture_detected != m_moisture_detected)
+    {
+        if (m_moisture_detected)
+        {
+            // Discard any confidence built up while the film formed
+            for (unsigned int i = 0; i < CAPSENSE_NUM_BUTTONS; i++)
+            {
+                m_debounce_pressed_confidence_level[i] = 0;
+                m_debounce_released_confidence_level[i] = 0;
+            }
+        }
+        m_cfg->callback(CAPSENSE_MOISTURE_EVENT, m_moisture_detected ? 1 : 0);
+    }
+
+    return m_moisture_detected;
+}
+#endif
+
+
+static uint16_t saturate_u16(uint32_t value)
+{
+    return (value > 0xFFFF) ? 0xFFFF : (uint16_t)value;
+}
+
+
+static int16_t saturate_s16(int32_t value)
+{
+    return (value > INT16_MAX) ? INT16_MAX : ((value < INT16_MIN) ? INT16_MIN : (int16_t)value);
+}
+
+
+// Update the feature vector with the samples of this scan
+static void features_update(void)
+{
+    for (unsigned int i = 0; i < CAPSENSE_NUM_BUTTONS; i++)
+    {
+        if ((m_scan_mask & (1 << i)) == 0)
+        {
+            continue;
+        }
+
+        uint32_t baseline = channel_baseline(i);
+        int32_t delta = (baseline > 0) ? (m_sample_delta[i] * 4096) / (int32_t)baseline : 0;
+        int16_t delta_q12 = saturate_s16(delta);
+        uint32_t power = ((uint32_t)(delta_q12 * delta_q12)) >> 12;
+
+        m_features.channel[i].velocity_q12 = saturate_s16((int32_t)delta_q12 - m_features.channel[i].delta_q12);
+        m_features.channel[i].delta_q12 = delta_q12;
+
+        m_feature_energy[i] += ((int32_t)power - (int32_t)m_feature_energy[i]) >> CAPSENSE_FEATURE_ENERGY_SHIFT;
+        m_features.channel[i].energy_q12 = saturate_u16(m_feature_energy[i]);
+    }
+}
+
+
+static void scan_complete()
+{
+    uint32_t pressed_mask = m_pressed_mask;
+
+    post_sampling_cleanup();
+    if (m_cfg->scan_handler)
+    {
+        m_cfg->scan_handler(m_sample, m_scan_mask);
+    }
+    if (m_cfg->classifier)
+    {
+        features_update();
+    }
+#if CAPSENSE_MOISTURE_REJECTION_ENABLED
+    if (moisture_detect())
+    {
+        // Freeze button state while the panel is wet
+        return;
+    }
+#endif
+    if (m_cfg->classifier)
+    {
+        pressed_mask = m_cfg->classifier(&m_features, m_scan_mask, m_pressed_mask);
+    }
+    debounce(pressed_mask);
+}
+
+
 static void sample_finalize()
 {
-    uint32_t sample = CAPSENSE_TIMER->CC[0];
-    bool pressed = analyze_sample(sample);
+    // Start measuring the next pin before analyzing this sample, so
+    // that the processing overlaps with the next measurement instead
+    // of adding to the scan time.
+    uint32_t sample = sample_half_period();
+    uint32_t pin_index = m_current_pin_index;
+
+    m_current_pin_index = next_pin_index(m_scan_mask, pin_index + 1);
+    if (m_current_pin_index < CAPSENSE_NUM_BUTTONS)
+    {
+        sample_initiate();
+    }
+
+    m_sample[pin_index] = sample;
+#if CAPSENSE_TIMESTAMP_ENABLED
+    m_sample_ticks[pin_index] = timestamp();
+#endif
+    m_sample_delta[pin_index] = (int32_t)sample - (int32_t)channel_baseline(pin_index);
+
+    if (analyze_sample(sample, pin_index))
+    {
+        m_pressed_mask |= 1 << pin_index;
+    }
+
+    if (m_current_pin_index < CAPSENSE_NUM_BUTTONS)
+    {
+        // More pins to do. The next measurement is already running.
+        return;
+    }
+
+    // This was the last pin. Time to debounce....
+    scan_complete();
 
-    if (pressed)
+#if CAPSENSE_FIXED_SLOT_ENABLED
+    if (m_fixed_slot_active)
     {
-        m_pressed_mask |= 1 << m_current_pin_index;
+        // Arm the first slot of the next scan
+        m_fixed_slot_scan_start = (m_fixed_slot_scan_start + m_fixed_slot_period) & RTC_COUNTER_MASK;
+        nrf_capsense_sample();
     }
+#endif
+}
+
+
+static void proximity_analyze(uint32_t sum)
+{
+    uint32_t baseline;
+    bool prev_detected = m_proximity_detected;
+
+    if (m_proximity_baseline_acc == 0)
+    {
+        // First proximity scan. Use it as the initial baseline.
+        m_proximity_baseline_acc = sum << CAPSENSE_PROXIMITY_BASELINE_SHIFT;
+    }
+
+    baseline = m_proximity_baseline_acc >> CAPSENSE_PROXIMITY_BASELINE_SHIFT;
+
+    if (m_proximity_detected)
+    {
+        // Use half the threshold for release to get some hysteresis
+        if (sum < (baseline + (m_tuning.proximity_threshold / 2)))
+        {
+            m_proximity_detected = false;
+        }
+    }
+    else if (sum > (baseline + m_tuning.proximity_threshold))
+    {
+        m_proximity_detected = true;
+        m_proximity_detected_scans = 0;
+    }
+
+    if (m_proximity_detected)
+    {
+        m_proximity_detected_scans++;
+        if (m_proximity_detected_scans >= CAPSENSE_PROXIMITY_MAX_DETECTED_SCANS)
+        {
+            // Detected for too long to be a hand. Assume the
+            // environment changed while the baseline was frozen, and
+            // start over from the current value.
+            m_proximity_detected = false;
+            m_proximity_baseline_acc = sum << CAPSENSE_PROXIMITY_BASELINE_SHIFT;
+        }
+    }
+    else
+    {
+        // Only track the environment when nothing is approaching, so
+        // that a hand held still is not absorbed into the baseline.
+        m_proximity_baseline_acc = m_proximity_baseline_acc + sum - baseline;
+    }
+
+    if (prev_detected != m_proximity_detected)
+    {
+        m_cfg->callback(CAPSENSE_PROXIMITY_EVENT, m_proximity_detected ? 1 : 0);
+    }
+}
+
+
+static void proximity_sample_finalize()
+{
+    m_proximity_sum += m_timer->CC[0];
+
+    if (m_proximity_period < (CAPSENSE_PROXIMITY_INTEGRATION_PERIODS - 1))
+    {
+        // Integrate more half periods on the same pin
+        m_proximity_period++;
+        sample_initiate();
+        return;
+    }
+
+    m_proximity_period = 0;
+    m_current_pin_index = next_pin_index(m_cfg->proximity_pin_mask, m_current_pin_index + 1);
+
+    if (m_current_pin_index < CAPSENSE_NUM_BUTTONS)
+    {
+        // More pins to do...
+        sample_initiate();
+    }
+    else
+    {
+        // This was the last pin of the combined electrode
+        m_proximity_active = false;
+        post_sampling_cleanup();
+        proximity_analyze(m_proximity_sum);
+    }
+}
+
+
+static uint32_t isqrt(uint64_t value)
+{
+    uint64_t root = 0;
+    uint64_t bit = 1ULL << 62;
+
+    while (bit > value)
+    {
+        bit >>= 2;
+    }
+
+    while (bit != 0)
+    {
+        if (value >= root + bit)
+        {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    return (uint32_t)root;
+}
+
+
+// Fill in the report for the current channel and continue with the
+// next channel, or finish the self-test.
+static void selftest_channel_complete(bool timeout)
+{
+    uint32_t n = CAPSENSE_SELFTEST_SCANS;
+    uint32_t mean = m_selftest_sum / n;
+    // Variance x 256, so that its root is the standard deviation x 16
+    uint64_t variance_q8 = ((n * m_selftest_sum_sq - (uint64_t)m_selftest_sum * m_selftest_sum) << 8) /
+                           ((uint64_t)n * n);
+    uint32_t noise_q4 = isqrt(variance_q8);
+    uint32_t reference = m_selftest_reference_delta * CAPSENSE_SELFTEST_PERIODS;
+    uint32_t snr_q4 = (noise_q4 == 0) ? 0xFFFF : (reference << 8) / noise_q4;
+    enum capsense_selftest_status_t status;
+
+    if (timeout)
+    {
+        mean = 0;
+        noise_q4 = 0;
+        snr_q4 = 0;
+        status = CAPSENSE_SELFTEST_SHORT;
+    }
+    else if (mean < (CAPSENSE_SELFTEST_OPEN_COUNTS * CAPSENSE_SELFTEST_PERIODS))
+    {
+        status = CAPSENSE_SELFTEST_OPEN;
+    }
+    else if (snr_q4 < (CAPSENSE_SELFTEST_MIN_SNR << 4))
+    {
+        status = CAPSENSE_SELFTEST_NOISY;
+    }
+    else
+    {
+        status = CAPSENSE_SELFTEST_OK;
+    }
+
+    m_selftest_report->channel[m_current_pin_index].baseline = saturate_u16(mean);
+    m_selftest_report->channel[m_current_pin_index].noise_q4 = saturate_u16(noise_q4);
+    m_selftest_report->channel[m_current_pin_index].snr_q4 = saturate_u16(snr_q4);
+    m_selftest_report->channel[m_current_pin_index].status = status;
+    if (status != CAPSENSE_SELFTEST_OK)
+    {
+        m_selftest_fail_mask |= 1 << m_current_pin_index;
+    }
+
+    m_selftest_period = 0;
+    m_selftest_sample = 0;
+    m_selftest_acc = 0;
+    m_selftest_sum = 0;
+    m_selftest_sum_sq = 0;
+
+    if (m_current_pin_index < (CAPSENSE_NUM_BUTTONS - 1))
+    {
+        // More pins to do...
+        m_current_pin_index++;
+        sample_initiate();
+    }
+    else
+    {
+        // This was the last pin
+        m_selftest_active = false;
+        post_sampling_cleanup();
+        m_cfg->callback(CAPSENSE_SELFTEST_EVENT, m_selftest_fail_mask);
+    }
+}
+
+
+static void selftest_sample_finalize()
+{
+    m_selftest_acc += m_timer->CC[0];
+
+    if (m_selftest_period < (CAPSENSE_SELFTEST_PERIODS - 1))
+    {
+        // Integrate more half periods
+        m_selftest_period++;
+        sample_initiate();
+        return;
+    }
+
+    m_selftest_sum += m_selftest_acc;
+    m_selftest_sum_sq += (uint64_t)m_selftest_acc * m_selftest_acc;
+    m_selftest_period = 0;
+    m_selftest_acc = 0;
+
+    if (m_selftest_sample < (CAPSENSE_SELFTEST_SCANS - 1))
+    {
+        m_selftest_sample++;
+        sample_initiate();
+    }
+    else
+    {
+        selftest_channel_complete(false);
+    }
+}
+
+
+#if CAPSENSE_COMPENSATION_ENABLED
+// Start a conversion of the die temperature, and of VDD with gain 1/6
+// and the internal 0.6 V reference (3.6 V full scale at 10 bit).
+static void environment_start(void)
+{
+    NRF_TEMP->EVENTS_DATARDY = 0;
+    NRF_TEMP->TASKS_START = 1;
+
+    NRF_SAADC->RESOLUTION = SAADC_RESOLUTION_VAL_10bit << SAADC_RESOLUTION_VAL_Pos;
+    NRF_SAADC->CH[0].PSELP = SAADC_CH_PSELP_PSELP_VDD << SAADC_CH_PSELP_PSELP_Pos;
+    NRF_SAADC->CH[0].PSELN = SAADC_CH_PSELN_PSELN_NC << SAADC_CH_PSELN_PSELN_Pos;
+    NRF_SAADC->CH[0].CONFIG = (SAADC_CH_CONFIG_GAIN_Gain1_6 << SAADC_CH_CONFIG_GAIN_Pos) |
+                              (SAADC_CH_CONFIG_REFSEL_Internal << SAADC_CH_CONFIG_REFSEL_Pos) |
+                              (SAADC_CH_CONFIG_TACQ_10us << SAADC_CH_CONFIG_TACQ_Pos);
+    NRF_SAADC->RESULT.PTR = (uint32_t)&m_saadc_result;
+    NRF_SAADC->RESULT.MAXCNT = 1;
+    NRF_SAADC->ENABLE = SAADC_ENABLE_ENABLE_Enabled << SAADC_ENABLE_ENABLE_Pos;
+    NRF_SAADC->EVENTS_STARTED = 0;
+    NRF_SAADC->TASKS_START = 1;
+}
+
+
+// Advance the environment conversion started by environment_start()
+// without waiting for the peripherals. Called once per scan, as the
+// scan may be started from an interrupt. Returns true, with the
+// result in environment, when the conversion has completed.
+static bool environment_poll(environment_t *environment)
+{
+    switch (m_environment_state)
+    {
+        case ENVIRONMENT_STARTING:
+            if (NRF_SAADC->EVENTS_STARTED)
+            {
+                NRF_SAADC->EVENTS_END = 0;
+                NRF_SAADC->TASKS_SAMPLE = 1;
+                m_environment_state = ENVIRONMENT_CONVERTING;
+            }
+            break;
+
+        case ENVIRONMENT_CONVERTING:
+            if (NRF_TEMP->EVENTS_DATARDY && NRF_SAADC->EVENTS_END)
+            {
+                NRF_TEMP->EVENTS_DATARDY = 0;
+                // Read before stopping, as the stop task clears the register
+                environment->temp = (int32_t)NRF_TEMP->TEMP;
+                NRF_TEMP->TASKS_STOP = 1;
+                environment->vdd = (m_saadc_result < 0) ? 0 : m_saadc_result;
+
+                NRF_SAADC->EVENTS_STOPPED = 0;
+                NRF_SAADC->TASKS_STOP = 1;
+                m_environment_state = ENVIRONMENT_STOPPING;
+                return true;
+            }
+            break;
+
+        case ENVIRONMENT_STOPPING:
+            if (NRF_SAADC->EVENTS_STOPPED)
+            {
+                NRF_SAADC->ENABLE = SAADC_ENABLE_ENABLE_Disabled << SAADC_ENABLE_ENABLE_Pos;
+                NRF_SAADC->CH[0].PSELP = SAADC_CH_PSELP_PSELP_NC << SAADC_CH_PSELP_PSELP_Pos;
+                m_environment_state = ENVIRONMENT_IDLE;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    return false;
+}
+
+
+// Update the environment correction of every channel
+static void compensation_apply(const environment_t *environment)
+{
+    for (unsigned int i = 0; i < CAPSENSE_NUM_BUTTONS; i++)
+    {
+        m_calibration_data[i].comp_offset =
+            (m_calibration_data[i].temp_coeff_q8 * (environment->temp - m_cal_environment.temp) +
+             m_calibration_data[i].vdd_coeff_q8 * (environment->vdd - m_cal_environment.vdd)) / 256;
+    }
+}
+
+
+// Learn the coefficients from the change between the previous and the
+// latest calibration, where only one of temperature and supply moved.
+static void compensation_learn(void)
+{
+    int32_t temp_delta = m_cal_environment.temp - m_prev_cal_environment.temp;
+    int32_t vdd_delta = m_cal_environment.vdd - m_prev_cal_environment.vdd;
+    bool temp_moved = (temp_delta >= CAPSENSE_COMPENSATION_MIN_TEMP_DELTA) ||
+                      (-temp_delta >= CAPSENSE_COMPENSATION_MIN_TEMP_DELTA);
+    bool vdd_moved = (vdd_delta >= CAPSENSE_COMPENSATION_MIN_VDD_DELTA) ||
+                     (-vdd_delta >= CAPSENSE_COMPENSATION_MIN_VDD_DELTA);
+
+    for (unsigned int i = 0; i < CAPSENSE_NUM_BUTTONS; i++)
+    {
+        int32_t average_delta = (int32_t)m_calibration_data[i].cal_average -
+                                (int32_t)m_calibration_data[i].prev_cal_average;
+
+        if (m_calibration_data[i].prev_cal_average == 0)
+        {
+            // No previous calibration to compare with
+            continue;
+        }
+        if (temp_moved && !vdd_moved)
+        {
+            m_calibration_data[i].temp_coeff_q8 = (average_delta * 256) / temp_delta;
+        }
+        else if (vdd_moved && !temp_moved)
+        {
+            m_calibration_data[i].vdd_coeff_q8 = (average_delta * 256) / vdd_delta;
+        }
+    }
+}
+
+
+// Run the environment measurement, every CAPSENSE_COMPENSATION_INTERVAL
+// scans, and correct the baselines with the latest result. The first
+// result after a calibration is taken as the environment of that
+// calibration. Never waits for a conversion.
+static void compensation_update(void)
+{
+    environment_t environment;
+
+    if ((m_environment_state == ENVIRONMENT_IDLE) && (m_compensation_scan == 0))
+    {
+        environment_start();
+        m_environment_state = ENVIRONMENT_STARTING;
+        m_environment_for_calibration = m_cal_environment_pending;
+    }
+    m_compensation_scan = (m_compensation_scan + 1) % CAPSENSE_COMPENSATION_INTERVAL;
+
+    if (!environment_poll(&environment))
+    {
+        return;
+    }
+
+    if (m_environment_for_calibration)
+    {
+        m_environment_for_calibration = false;
+        m_prev_cal_environment = m_cal_environment;
+        m_cal_environment = environment;
+        if (m_cal_environment_valid)
+        {
+            compensation_learn();
+        }
+        m_cal_environment_valid = true;
+        m_cal_environment_pending = false;
+    }
+    else if (m_cal_environment_pending)
+    {
+        // Started before a calibration, so it does not match the new
+        // calibrated averages. Drop it and measure again on the next
+        // scan.
+        m_compensation_scan = 0;
+    }
+    else if (m_cal_environment_valid)
+    {
+        compensation_apply(&environment);
+    }
+}
+#endif
+
+
+#if CAPSENSE_COMP_AUTOSELECT_ENABLED
+// Conclude the current candidate on the current channel and continue
+// the sweep. counts is the average half period, or 0 on a timeout.
+static void comp_sweep_candidate_complete(uint32_t counts)
+{
+    bool best_reaches_target = m_comp_sweep_best_counts >= CAPSENSE_COMP_AUTOSELECT_TARGET_COUNTS;
+
+    if (counts >= CAPSENSE_COMP_AUTOSELECT_TARGET_COUNTS)
+    {
+        // Reaches the target. Prefer the shortest such setting.
+        if (!best_reaches_target || (counts < m_comp_sweep_best_counts))
+        {
+            m_comp_sweep_best = m_comp_sweep_candidate;
+            m_comp_sweep_best_counts = counts;
+        }
+    }
+    else if (!best_reaches_target && (counts > m_comp_sweep_best_counts))
+    {
+        // Nothing reaches the target so far. Prefer the most counts.
+        m_comp_sweep_best = m_comp_sweep_candidate;
+        m_comp_sweep_best_counts = counts;
+    }
+
+    m_comp_sweep_sample = 0;
+    m_comp_sweep_acc = 0;
+
+    if (m_comp_sweep_candidate < (COMP_SETTING_COUNT - 1))
+    {
+        m_comp_sweep_candidate++;
+        sample_initiate();
+        return;
+    }
+
+    // All candidates done for this pin
+#if CAPSENSE_COMPENSATION_ENABLED
+    if (m_comp_setting[m_current_pin_index] != m_comp_sweep_best)
+    {
+        // Counts under the new setting do not compare with those
+        // under the old one. Forget what was learned, and let the
+        // next calibrations learn again.
+        m_calibration_data[m_current_pin_index].prev_cal_average = 0;
+        m_calibration_data[m_current_pin_index].temp_coeff_q8 = 0;
+        m_calibration_data[m_current_pin_index].vdd_coeff_q8 = 0;
+    }
+#endif
+    m_comp_setting[m_current_pin_index] = m_comp_sweep_best;
+    m_comp_sweep_candidate = 0;
+    m_comp_sweep_best = 0;
+    m_comp_sweep_best_counts = 0;
 
     if (m_current_pin_index < (CAPSENSE_NUM_BUTTONS - 1))
     {
-        // More pins to do...
-        m_current_pin_index++;
+        m_current_pin_index++;
+    }
+    else
+    {
+        // Sweep done. Calibrate with the selected settings.
+        m_comp_sweep_active = false;
+        m_current_pin_index = 0;
+    }
+    sample_initiate();
+}
+
+
+static void comp_sweep_sample_finalize()
+{
+    m_comp_sweep_acc += m_timer->CC[0];
+
+    if (m_comp_sweep_sample < (CAPSENSE_COMP_AUTOSELECT_SAMPLES - 1))
+    {
+        m_comp_sweep_sample++;
         sample_initiate();
     }
     else
     {
-        // This was the last pin. Time to debounce....
-        post_sampling_cleanup();
-        debounce(m_pressed_mask);
+        comp_sweep_candidate_complete(m_comp_sweep_acc / CAPSENSE_COMP_AUTOSELECT_SAMPLES);
     }
 }
+#endif
 
 
 static void config_comparator(void)
@@ -141,9 +1079,8 @@ static void config_comparator(void)
     // The comparator is not enabled at this stage, as it will be done
     // whenever sampling a pin.
     NRF_COMP->REFSEL = (COMP_REFSEL_REFSEL_VDD << COMP_REFSEL_REFSEL_Pos);
-    NRF_COMP->TH = (5 << COMP_TH_THDOWN_Pos) | (60 << COMP_TH_THUP_Pos);
-    NRF_COMP->MODE = (COMP_MODE_MAIN_SE << COMP_MODE_MAIN_Pos) | (COMP_MODE_SP_High << COMP_MODE_SP_Pos);
-    NRF_COMP->ISOURCE = (COMP_ISOURCE_ISOURCE_Ien10mA << COMP_ISOURCE_ISOURCE_Pos);
+    // Threshold, mode and current source of the fixed setting
+    comp_setting_apply(0);
     // Trigger interrupt on EVENTS_DOWN
     NRF_COMP->INTENSET = COMP_INTEN_DOWN_Msk;
     // Shortcut between events_down and task_stop
@@ -154,47 +1091,223 @@ static void config_comparator(void)
 static void config_timer(void)
 {
     // Use CC[0] for timing the period of the oscilator (will be set
-    // by PPI). Use CC[1] as a timeout that triggers a interrupt.
+    // by PPI). Use CC[1] as a timeout that triggers a interrupt,
+    // counted from the start of each measurement.
     // 16 bit timer
-    CAPSENSE_TIMER->PRESCALER = 0;
-    CAPSENSE_TIMER->BITMODE = TIMER_BITMODE_BITMODE_16Bit << TIMER_BITMODE_BITMODE_Pos;
+    m_timer->PRESCALER = 0;
+    m_timer->BITMODE = TIMER_BITMODE_BITMODE_16Bit << TIMER_BITMODE_BITMODE_Pos;
     // Configure timeout
-    CAPSENSE_TIMER->CC[1] = 1000*16;
-    CAPSENSE_TIMER->SHORTS = TIMER_SHORTS_COMPARE1_CLEAR_Msk | TIMER_SHORTS_COMPARE1_STOP_Msk;
-    CAPSENSE_TIMER->INTENSET = TIMER_INTENSET_COMPARE1_Msk;
+    m_timer->CC[1] = TIMER_TIMEOUT_TICKS;
+    m_timer->SHORTS = TIMER_SHORTS_COMPARE1_CLEAR_Msk | TIMER_SHORTS_COMPARE1_STOP_Msk;
+    m_timer->INTENSET = TIMER_INTENSET_COMPARE1_Msk;
     // Clear timer
-    CAPSENSE_TIMER->TASKS_CLEAR = 1;
+    m_timer->TASKS_CLEAR = 1;
 }
 
 
 static void config_ppi(void)
 {
-    // Use PPI to start timer at upward crossing
-    NRF_PPI->CH[CAPSENSE_PPI_CH0].EEP = (uint32_t)&NRF_COMP->EVENTS_UP;
-    NRF_PPI->CH[CAPSENSE_PPI_CH0].TEP = (uint32_t)&CAPSENSE_TIMER->TASKS_START;
-    NRF_PPI->CHENSET = 1 << CAPSENSE_PPI_CH0;
+    // Use PPI to clear the (already running) timer at upward crossing
+    NRF_PPI->CH[m_resources.ppi_ch_clear].EEP = (uint32_t)&NRF_COMP->EVENTS_UP;
+    NRF_PPI->CH[m_resources.ppi_ch_clear].TEP = (uint32_t)&m_timer->TASKS_CLEAR;
+    NRF_PPI->CHENSET = 1 << m_resources.ppi_ch_clear;
 
     // Use PPI to capture timer at downward crossing to CC[0] and stop
     // the timer
-    NRF_PPI->CH[CAPSENSE_PPI_CH1].EEP = (uint32_t)&NRF_COMP->EVENTS_DOWN;
-    NRF_PPI->CH[CAPSENSE_PPI_CH1].TEP = (uint32_t)&CAPSENSE_TIMER->TASKS_CAPTURE[0];
-    NRF_PPI->FORK[CAPSENSE_PPI_CH1].TEP = (uint32_t)&CAPSENSE_TIMER->TASKS_STOP;
-    NRF_PPI->CHENSET = 1 << CAPSENSE_PPI_CH1;
+    NRF_PPI->CH[m_resources.ppi_ch_capture].EEP = (uint32_t)&NRF_COMP->EVENTS_DOWN;
+    NRF_PPI->CH[m_resources.ppi_ch_capture].TEP = (uint32_t)&m_timer->TASKS_CAPTURE[0];
+    NRF_PPI->FORK[m_resources.ppi_ch_capture].TEP = (uint32_t)&m_timer->TASKS_STOP;
+    NRF_PPI->CHENSET = 1 << m_resources.ppi_ch_capture;
+}
+
+
+#if CAPSENSE_GUARD_ENABLED
+static void config_guard(void)
+{
+    // Guard pin is a GPIOTE task output, idle low
+    NRF_GPIOTE->CONFIG[CAPSENSE_GUARD_GPIOTE_CH] =
+        (GPIOTE_CONFIG_MODE_Task << GPIOTE_CONFIG_MODE_Pos) |
+        (CAPSENSE_GUARD_PIN << GPIOTE_CONFIG_PSEL_Pos) |
+        (GPIOTE_CONFIG_POLARITY_Toggle << GPIOTE_CONFIG_POLARITY_Pos) |
+        (GPIOTE_CONFIG_OUTINIT_Low << GPIOTE_CONFIG_OUTINIT_Pos);
+
+    // Pull the guard low at the upward crossing, together with
+    // clearing the timer
+    NRF_PPI->FORK[m_resources.ppi_ch_clear].TEP = (uint32_t)&NRF_GPIOTE->TASKS_CLR[CAPSENSE_GUARD_GPIOTE_CH];
 }
+#endif
 
 
 static void enable_interrupts(void)
 {
-    NVIC_SetPriority(CAPSENSE_TIMER_IRQ, 3);
-    NVIC_EnableIRQ(CAPSENSE_TIMER_IRQ);
-    NVIC_SetPriority(LPCOMP_IRQn, 3);
+    IRQn_Type timer_irqn = nrf_resource_timer_irqn(m_timer_index);
+
+    NVIC_SetPriority(timer_irqn, m_resources.irq_priority);
+    NVIC_EnableIRQ(timer_irqn);
+    // COMP and LPCOMP share this interrupt. Only COMP is used, as
+    // LPCOMP has no current source for capacitive sensing.
+    NVIC_SetPriority(LPCOMP_IRQn, m_resources.irq_priority);
     NVIC_EnableIRQ(LPCOMP_IRQn);
 }
 
 
+#define RESOURCE_LIST_LENGTH    7
+
+
+typedef struct
+{
+    nrf_resource_type_t type;
+    uint32_t index;
+} resource_t;
+
+
+// Fill list with every resource of a configuration. Returns the number
+// of resources, or 0 if the configuration is invalid.
+static uint32_t resource_list(const nrf_capsense_resources_t *resources, resource_t *list)
+{
+    uint32_t count = 0;
+    uint32_t index;
+
+    if ((resources->irq_priority >= IRQ_PRIORITY_COUNT) ||
+        (resources->ppi_ch_clear == resources->ppi_ch_capture))
+    {
+        return 0;
+    }
+#if CAPSENSE_FIXED_SLOT_ENABLED
+    if ((resources->ppi_ch_slot == resources->ppi_ch_clear) ||
+        (resources->ppi_ch_slot == resources->ppi_ch_capture))
+    {
+        return 0;
+    }
+#endif
+
+    if (nrf_resource_index(NRF_RESOURCE_TIMER, resources->timer, &index) != NRF_SUCCESS)
+    {
+        return 0;
+    }
+    list[count++] = (resource_t){NRF_RESOURCE_TIMER, index};
+    list[count++] = (resource_t){NRF_RESOURCE_COMP, 0};
+    list[count++] = (resource_t){NRF_RESOURCE_PPI_CHANNEL, resources->ppi_ch_clear};
+    list[count++] = (resource_t){NRF_RESOURCE_PPI_CHANNEL, resources->ppi_ch_capture};
+#if CAPSENSE_FIXED_SLOT_ENABLED
+    list[count++] = (resource_t){NRF_RESOURCE_PPI_CHANNEL, resources->ppi_ch_slot};
+    if (nrf_resource_index(NRF_RESOURCE_RTC, CAPSENSE_RTC, &index) != NRF_SUCCESS)
+    {
+        return 0;
+    }
+    list[count++] = (resource_t){NRF_RESOURCE_RTC, index};
+#endif
+#if CAPSENSE_GUARD_ENABLED
+    list[count++] = (resource_t){NRF_RESOURCE_GPIOTE_CHANNEL, CAPSENSE_GUARD_GPIOTE_CH};
+#endif
+
+    return count;
+}
+
+
+static bool resource_listed(const resource_t *list, uint32_t count, const resource_t *resource)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if ((list[i].type == resource->type) && (list[i].index == resource->index))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+// Claim every resource of a configuration, or none. Resources already
+// claimed by the library (for the current configuration) are kept.
+static uint32_t claim_resources(const nrf_capsense_resources_t *resources)
+{
+    resource_t list[RESOURCE_LIST_LENGTH];
+    bool claimed[RESOURCE_LIST_LENGTH];
+    uint32_t count = resource_list(resources, list);
+    uint32_t err_code = NRF_SUCCESS;
+    uint32_t i;
+
+    if (count == 0)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    for (i = 0; (i < count) && (err_code == NRF_SUCCESS); i++)
+    {
+        claimed[i] = false;
+        if (nrf_resource_owner(list[i].type, list[i].index) != m_resource_owner)
+        {
+            err_code = nrf_resource_claim(list[i].type, list[i].index, m_resource_owner);
+            claimed[i] = (err_code == NRF_SUCCESS);
+        }
+    }
+
+    if (err_code != NRF_SUCCESS)
+    {
+        // Give back what was claimed here, and nothing else
+        while (i-- > 0)
+        {
+            if (claimed[i])
+            {
+                (void)nrf_resource_release(list[i].type, list[i].index, m_resource_owner);
+            }
+        }
+    }
+    return err_code;
+}
+
+
+// Undo the wiring of a stopped resource, so that the next owner does
+// not inherit PPI endpoints or a GPIOTE pin from the library
+static void resource_reset(const resource_t *resource)
+{
+    switch (resource->type)
+    {
+        case NRF_RESOURCE_PPI_CHANNEL:
+            NRF_PPI->CHENCLR = 1 << resource->index;
+            NRF_PPI->CH[resource->index].EEP = 0;
+            NRF_PPI->CH[resource->index].TEP = 0;
+            NRF_PPI->FORK[resource->index].TEP = 0;
+            break;
+
+#if CAPSENSE_GUARD_ENABLED
+        case NRF_RESOURCE_GPIOTE_CHANNEL:
+            NRF_GPIOTE->CONFIG[resource->index] = 0;
+            break;
+#endif
+
+        default:
+            // Stopped by hardware_stop()
+            break;
+    }
+}
+
+
+// Release the resources of the current configuration that are not
+// part of the new one
+static void release_unused_resources(const nrf_capsense_resources_t *resources)
+{
+    resource_t current[RESOURCE_LIST_LENGTH];
+    resource_t next[RESOURCE_LIST_LENGTH];
+    uint32_t current_count = resource_list(&m_resources, current);
+    uint32_t next_count = resource_list(resources, next);
+
+    for (uint32_t i = 0; i < current_count; i++)
+    {
+        if (!resource_listed(next, next_count, &current[i]))
+        {
+            resource_reset(&current[i]);
+            (void)nrf_resource_release(current[i].type, current[i].index, m_resource_owner);
+        }
+    }
+}
+
+
 static void calibration_sample_finalize()
 {
-    uint32_t sample = CAPSENSE_TIMER->CC[0];
+    uint32_t sample = m_timer->CC[0];
 
     if ((sample > m_calibration_data[m_current_pin_index].cal_val_max) ||
         (sample < m_calibration_data[m_current_pin_index].cal_val_min))
@@ -248,10 +1361,25 @@ void COMP_LPCOMP_IRQHandler(void)
     if (NRF_COMP->EVENTS_DOWN)
     {
         NRF_COMP->EVENTS_DOWN = 0;
+#if CAPSENSE_COMP_AUTOSELECT_ENABLED
+        if (m_comp_sweep_active)
+        {
+            comp_sweep_sample_finalize();
+        }
+        else
+#endif
         if (m_calibration_active)
         {
             calibration_sample_finalize();
         }
+        else if (m_selftest_active)
+        {
+            selftest_sample_finalize();
+        }
+        else if (m_proximity_active)
+        {
+            proximity_sample_finalize();
+        }
         else
         {
             sample_finalize();
@@ -260,37 +1388,142 @@ void COMP_LPCOMP_IRQHandler(void)
 }
 
 
-void CAPSENSE_TIMER_IRQHandler(void)
+void nrf_capsense_timer_irq_handler(void)
 {
     // This interrupt is only triggered when a timeout has occured.
 
-    if (CAPSENSE_TIMER->EVENTS_COMPARE[1])
+    if (m_timer->EVENTS_COMPARE[1])
     {
-        CAPSENSE_TIMER->EVENTS_COMPARE[1] = 0;
-        CAPSENSE_TIMER->TASKS_STOP = 1;
+        m_timer->EVENTS_COMPARE[1] = 0;
+        m_timer->TASKS_STOP = 1;
+#if CAPSENSE_COMP_AUTOSELECT_ENABLED
+        if (m_comp_sweep_active)
+        {
+            // Too slow with this setting. Rule it out and go on.
+            NRF_COMP->TASKS_STOP = 1;
+            comp_sweep_candidate_complete(0);
+            return;
+        }
+#endif
+#if CAPSENSE_FIXED_SLOT_ENABLED
+        if (m_fixed_slot_active && !m_calibration_active && !m_selftest_active && !m_proximity_active)
+        {
+            // Slot overrun. Count the channel as released and keep
+            // the schedule.
+            NRF_COMP->TASKS_STOP = 1;
+            m_timer->CC[0] = 0;
+            m_timer->CC[2] = 0;
+            sample_finalize();
+            m_cfg->callback(CAPSENSE_TIMEOUT_EVENT, 0);
+            return;
+        }
+#endif
+        if (m_selftest_active)
+        {
+            // Expected for a shorted electrode. Record it and go on
+            // with the next channel.
+            NRF_COMP->TASKS_STOP = 1;
+            selftest_channel_complete(true);
+            return;
+        }
+        m_proximity_active = false;
         post_sampling_cleanup();
         m_cfg->callback(CAPSENSE_TIMEOUT_EVENT, 0);
     }
 }
 
 
-void nrf_capsense_init(nrf_capsense_cfg_t *cfg)
+// Stop the peripherals of the current configuration, so that they can
+// be given up or set up again
+static void hardware_stop(void)
 {
-    m_cfg = cfg;
+    NVIC_DisableIRQ(nrf_resource_timer_irqn(m_timer_index));
+    NVIC_DisableIRQ(LPCOMP_IRQn);
 
-    for (unsigned int i = 0; i < CAPSENSE_NUM_BUTTONS; i++)
+#if CAPSENSE_FIXED_SLOT_ENABLED
+    if (m_fixed_slot_active)
     {
-        m_calibration_data[i].cal_val_min = ~0;
-        m_calibration_data[i].cal_val_max = 0;
+        m_fixed_slot_active = false;
+        CAPSENSE_RTC->TASKS_STOP = 1;
+        CAPSENSE_RTC->EVTENCLR = RTC_EVTEN_COMPARE0_Msk;
+        NRF_PPI->CHENCLR = 1 << m_resources.ppi_ch_slot;
     }
+#endif
+    NRF_PPI->CHENCLR = (1 << m_resources.ppi_ch_clear) | (1 << m_resources.ppi_ch_capture);
+
+    NRF_COMP->TASKS_STOP = 1;
+    NRF_COMP->INTENCLR = COMP_INTENCLR_DOWN_Msk;
+    m_timer->TASKS_STOP = 1;
+    m_timer->INTENCLR = TIMER_INTENCLR_COMPARE1_Msk;
+}
+
 
+// Set up the peripherals of the current configuration
+static void hardware_start(void)
+{
     config_comparator();
     config_timer();
     config_ppi();
+#if CAPSENSE_GUARD_ENABLED
+    config_guard();
+#endif
     enable_interrupts();
 }
 
 
+uint32_t nrf_capsense_init(nrf_capsense_cfg_t *cfg)
+{
+    uint32_t err_code;
+    uint32_t timer_index;
+    bool initialized = (m_cfg != 0);
+
+    // Stop a previous configuration before touching the hardware. Its
+    // resources are kept until the new ones are claimed, so that it
+    // can be restored if that fails.
+    if (initialized)
+    {
+        hardware_stop();
+    }
+
+    err_code = claim_resources(&cfg->resources);
+    if (err_code != NRF_SUCCESS)
+    {
+        if (initialized)
+        {
+            hardware_start();
+        }
+        return err_code;
+    }
+
+    if (initialized)
+    {
+        release_unused_resources(&cfg->resources);
+    }
+
+    (void)nrf_resource_index(NRF_RESOURCE_TIMER, cfg->resources.timer, &timer_index);
+    if (nrf_resource_timer_dispatched(timer_index))
+    {
+        // Otherwise the application calls nrf_capsense_timer_irq_handler()
+        (void)nrf_resource_timer_handler_set(timer_index, nrf_capsense_timer_irq_handler, m_resource_owner);
+    }
+
+    m_cfg = cfg;
+    m_resources = cfg->resources;
+    m_timer = cfg->resources.timer;
+    m_timer_index = timer_index;
+
+    for (unsigned int i = 0; i < CAPSENSE_NUM_BUTTONS; i++)
+    {
+        m_calibration_data[i].cal_val_min = ~0;
+        m_calibration_data[i].cal_val_max = 0;
+    }
+
+    hardware_start();
+
+    return NRF_SUCCESS;
+}
+
+
 static void prepare_for_sampling()
 {
     // Set constant latency mode to force the clock active. It will be
@@ -303,18 +1536,301 @@ static void prepare_for_sampling()
 }
 
 
+#if CAPSENSE_PARTIAL_SCAN_ENABLED
+// Return the channels to sample in the next scan: active channels and
+// their neighbours, plus a round robin selection of the rest.
+static uint32_t partial_scan_mask(void)
+{
+    uint32_t active_mask = m_debounced_pin_mask;
+    uint32_t scan_mask;
+    uint32_t idle_mask;
+
+    for (unsigned int i = 0; i < CAPSENSE_NUM_BUTTONS; i++)
+    {
+        if (m_debounce_pressed_confidence_level[i] > 0)
+        {
+            active_mask |= 1 << i;
+        }
+    }
+
+#if CAPSENSE_MOISTURE_REJECTION_ENABLED
+    if ((active_mask != 0) || m_moisture_detected)
+    {
+        // A film can only be told from touches on a full scan. Scan
+        // every channel while anything is active or the panel is wet.
+        return m_tuning.channel_mask;
+    }
+#endif
+
+    scan_mask = (active_mask | (active_mask << 1) | (active_mask >> 1)) & m_tuning.channel_mask;
+    idle_mask = m_tuning.channel_mask & ~scan_mask;
+
+    for (unsigned int n = 0; (n < CAPSENSE_PARTIAL_SCAN_IDLE_CHANNELS) && (idle_mask != 0); n++)
+    {
+        m_round_robin_index = next_pin_index(idle_mask, m_round_robin_index);
+        if (m_round_robin_index >= CAPSENSE_NUM_BUTTONS)
+        {
+            // Wrap around
+            m_round_robin_index = next_pin_index(idle_mask, 0);
+        }
+        scan_mask |= 1 << m_round_robin_index;
+        idle_mask &= ~(1 << m_round_robin_index);
+        m_round_robin_index++;
+    }
+
+    return scan_mask;
+}
+#endif
+
+
+void nrf_capsense_sample_mask(uint32_t pin_mask)
+{
+    tuning_apply_pending();
+
+#if CAPSENSE_COMPENSATION_ENABLED
+    compensation_update();
+#endif
+
+    m_scan_mask = pin_mask & m_tuning.channel_mask;
+    m_current_pin_index = next_pin_index(m_scan_mask, 0);
+    m_pressed_mask = 0;
+
+    if (m_current_pin_index >= CAPSENSE_NUM_BUTTONS)
+    {
+        // Nothing to sample. Let debounce release any buttons on
+        // disabled channels.
+        debounce(0);
+        return;
+    }
+
+    prepare_for_sampling();
+}
+
+
 void nrf_capsense_sample(void)
 {
+#if CAPSENSE_PARTIAL_SCAN_ENABLED
+    // The scheduler must see the tuning the scan will use
+    tuning_apply_pending();
+    nrf_capsense_sample_mask(partial_scan_mask());
+#else
+    nrf_capsense_sample_mask((1UL << CAPSENSE_NUM_BUTTONS) - 1);
+#endif
+}
+
+
+void nrf_capsense_proximity_reset(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    m_proximity_detected = false;
+    m_proximity_detected_scans = 0;
+    m_proximity_baseline_acc = 0;
+    __set_PRIMASK(primask);
+}
+
+
+uint32_t nrf_capsense_proximity_sample(void)
+{
+#if CAPSENSE_FIXED_SLOT_ENABLED
+    if (m_fixed_slot_active)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+#endif
+    tuning_apply_pending();
+
+    m_current_pin_index = next_pin_index(m_cfg->proximity_pin_mask, 0);
+    if (m_current_pin_index >= CAPSENSE_NUM_BUTTONS)
+    {
+        // No pins configured for proximity detection
+        return NRF_SUCCESS;
+    }
+
+    m_proximity_active = true;
+    m_proximity_period = 0;
+    m_proximity_sum = 0;
+    prepare_for_sampling();
+
+    return NRF_SUCCESS;
+}
+
+
+uint32_t nrf_capsense_selftest(nrf_capsense_selftest_report_t *report, uint32_t reference_delta)
+{
+#if CAPSENSE_FIXED_SLOT_ENABLED
+    if (m_fixed_slot_active)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+#endif
+    m_selftest_report = report;
+    m_selftest_reference_delta = reference_delta;
+    m_selftest_fail_mask = 0;
+    m_selftest_period = 0;
+    m_selftest_sample = 0;
+    m_selftest_acc = 0;
+    m_selftest_sum = 0;
+    m_selftest_sum_sq = 0;
+    m_selftest_active = true;
     m_current_pin_index = 0;
-    m_pressed_mask = 0;
     prepare_for_sampling();
+
+    return NRF_SUCCESS;
 }
 
 
-void nrf_capsense_calibrate(void)
+uint32_t nrf_capsense_calibrate(void)
 {
+#if CAPSENSE_FIXED_SLOT_ENABLED
+    if (m_fixed_slot_active)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+#endif
+    tuning_apply_pending();
+
+    // Start from scratch, so that a recalibration reflects the
+    // current environment only.
+    for (unsigned int i = 0; i < CAPSENSE_NUM_BUTTONS; i++)
+    {
+#if CAPSENSE_COMPENSATION_ENABLED
+        m_calibration_data[i].prev_cal_average = m_calibration_data[i].cal_average;
+#endif
+        m_calibration_data[i].cal_val_min = ~0;
+        m_calibration_data[i].cal_val_max = 0;
+        m_calibration_data[i].comp_offset = 0;
+    }
+
+#if CAPSENSE_COMPENSATION_ENABLED
+    // The environment is measured by the first scans after the
+    // calibration, and learned from then.
+    m_compensation_scan = 0;
+    m_cal_environment_pending = true;
+    m_environment_for_calibration = false;
+#endif
+
     m_calibration_active = true;
     m_current_pin_index = 0;
     m_calibration_run = 0;
+#if CAPSENSE_COMP_AUTOSELECT_ENABLED
+    m_comp_sweep_active = true;
+    m_comp_sweep_candidate = 0;
+    m_comp_sweep_sample = 0;
+    m_comp_sweep_acc = 0;
+    m_comp_sweep_best = 0;
+    m_comp_sweep_best_counts = 0;
+#endif
     prepare_for_sampling();
+
+    return NRF_SUCCESS;
+}
+
+
+uint32_t nrf_capsense_tuning_set(const nrf_capsense_tuning_t *tuning)
+{
+    uint32_t primask;
+
+    if ((tuning->channel_mask & ~((1UL << CAPSENSE_NUM_BUTTONS) - 1)) != 0)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+    m_pending_tuning = *tuning;
+    m_tuning_pending = true;
+    __set_PRIMASK(primask);
+
+    return NRF_SUCCESS;
+}
+
+
+void nrf_capsense_tuning_get(nrf_capsense_tuning_t *tuning)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    *tuning = m_tuning_pending ? m_pending_tuning : m_tuning;
+    __set_PRIMASK(primask);
+}
+
+
+#if CAPSENSE_TIMESTAMP_ENABLED
+void nrf_capsense_event_info_get(nrf_capsense_event_info_t *info)
+{
+    *info = m_event_info;
+}
+#endif
+
+
+#if CAPSENSE_FIXED_SLOT_ENABLED
+uint32_t nrf_capsense_fixed_slot_start(uint32_t period_ticks)
+{
+    if ((period_ticks < CAPSENSE_NUM_BUTTONS * CAPSENSE_FIXED_SLOT_TICKS) ||
+        (period_ticks >= RTC_COUNTER_MASK / 2))
+    {
+        // Every slot of a scan must fit in the period, and the next
+        // scan start must be seen as ahead by fixed_slot_arm().
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    if (m_calibration_active || m_selftest_active || m_proximity_active)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+
+    m_fixed_slot_period = period_ticks;
+
+    // A measurement must end within its slot, leaving time for the
+    // interrupt to arm the next one. The timer is started at the slot
+    // start and not cleared by the upward crossing, which is captured
+    // to CC[2] instead, so that CC[1] is counted from the slot start.
+    m_timer->CC[1] = CAPSENSE_FIXED_SLOT_TICKS * TIMER_TICKS_PER_RTC_TICK - 16 * 16;
+    NRF_PPI->CH[m_resources.ppi_ch_clear].TEP = (uint32_t)&m_timer->TASKS_CAPTURE[2];
+
+    // RTC compare starts both the COMP and the timer
+    NRF_PPI->CH[m_resources.ppi_ch_slot].EEP = (uint32_t)&CAPSENSE_RTC->EVENTS_COMPARE[0];
+    NRF_PPI->CH[m_resources.ppi_ch_slot].TEP = (uint32_t)&NRF_COMP->TASKS_START;
+    NRF_PPI->FORK[m_resources.ppi_ch_slot].TEP = (uint32_t)&m_timer->TASKS_START;
+    NRF_PPI->CHENSET = 1 << m_resources.ppi_ch_slot;
+
+    // PRESCALER can only be written while the RTC is stopped
+    CAPSENSE_RTC->TASKS_STOP = 1;
+    CAPSENSE_RTC->PRESCALER = 0;
+    CAPSENSE_RTC->EVTENSET = RTC_EVTEN_COMPARE0_Msk;
+    CAPSENSE_RTC->TASKS_CLEAR = 1;
+    CAPSENSE_RTC->TASKS_START = 1;
+
+    // First scan one period from now
+    m_fixed_slot_active = true;
+    m_fixed_slot_scan_start = period_ticks & RTC_COUNTER_MASK;
+    nrf_capsense_sample();
+
+    return NRF_SUCCESS;
+}
+
+
+void nrf_capsense_fixed_slot_stop(void)
+{
+    m_fixed_slot_active = false;
+
+    CAPSENSE_RTC->TASKS_STOP = 1;
+    CAPSENSE_RTC->EVTENCLR = RTC_EVTEN_COMPARE0_Msk;
+    NRF_PPI->CHENCLR = 1 << m_resources.ppi_ch_slot;
+    NRF_COMP->TASKS_STOP = 1;
+    m_timer->TASKS_STOP = 1;
+    m_timer->CC[1] = TIMER_TIMEOUT_TICKS;
+    NRF_PPI->CH[m_resources.ppi_ch_clear].TEP = (uint32_t)&m_timer->TASKS_CLEAR;
+    post_sampling_cleanup();
+}
+
+
+uint32_t nrf_capsense_fixed_slot_latency_us(void)
+{
+    // One period until the touch is first sampled, one period per
+    // further debounce sample, and the slots of the deciding scan.
+    uint64_t ticks = (uint64_t)m_fixed_slot_period * (m_tuning.debounce_threshold + 1) +
+                     CAPSENSE_NUM_BUTTONS * CAPSENSE_FIXED_SLOT_TICKS;
+
+    return (uint32_t)((ticks * 1000000) / 32768);
 }
+#endif
@@ -10,33 +10,161 @@
  *
  */
 
+#ifndef NRF_CAPSENSE_H__
+#define NRF_CAPSENSE_H__
+
 #include <stdint.h>
+#include "nrf.h"
 #include "nrf_capsense_cfg.h"
 
 // Capsense event.
-enum capsense_event_t {CAPSENSE_BUTTON_EVENT, CAPSENSE_CALIBRATION_EVENT, CAPSENSE_TIMEOUT_EVENT};
+enum capsense_event_t {CAPSENSE_BUTTON_EVENT, CAPSENSE_CALIBRATION_EVENT, CAPSENSE_TIMEOUT_EVENT,
+                       CAPSENSE_PROXIMITY_EVENT, CAPSENSE_MOISTURE_EVENT, CAPSENSE_SELFTEST_EVENT};
 
 
 // Call back event handler implemented by the application. The event
 // will always be valid. However, the pin_mask will only be valid when
-// the event is CAPSENSE_BUTTON_EVENT.
+// the event is CAPSENSE_BUTTON_EVENT or CAPSENSE_PROXIMITY_EVENT. For
+// CAPSENSE_PROXIMITY_EVENT the pin_mask is 1 when an approach is
+// detected and 0 when it is no longer detected. For
+// CAPSENSE_MOISTURE_EVENT the pin_mask is 1 when the panel is found
+// wet (button events are suspended) and 0 when it is dry again. For
+// CAPSENSE_SELFTEST_EVENT the pin_mask holds the channels (index mask)
+// that failed the self-test.
 typedef void (*capsense_callback_t)(enum capsense_event_t event, uint32_t pin_mask);
 
 
+// Scan handler, optionally implemented by the application. Called
+// from interrupt context at the end of every button scan, before
+// debouncing. samples holds the captured half period of each channel
+// in 16 MHz ticks; only the channels in scan_mask were sampled in this
+// scan. Keep it short, as the next scan cannot start until it returns.
+typedef void (*capsense_scan_handler_t)(const uint32_t *samples, uint32_t scan_mask);
+
+
+// Per-scan feature vector, for classifiers that need more than the
+// threshold decision. Fixed point with 12 fractional bits, so that
+// 4096 is a change equal to the channel baseline. Channels not sampled
+// in a scan keep the features of their previous scan.
+typedef struct
+{
+    struct
+    {
+        int16_t  delta_q12;                       // (sample - baseline) / baseline
+        int16_t  velocity_q12;                    // Change of delta_q12 since the previous scan
+        uint16_t energy_q12;                      // Running mean of delta_q12 squared
+    } channel[CAPSENSE_NUM_BUTTONS];
+} nrf_capsense_features_t;
+
+
+// Classifier, optionally implemented by the application. Called from
+// interrupt context at the end of every button scan, after moisture
+// rejection and before debouncing. pressed_mask holds the channels
+// (index mask) above the press threshold in this scan. The returned
+// mask replaces it as input to debouncing, so the classifier can
+// reject e.g. palms or objects, or accept touches below the
+// threshold. Keep it short, as the next scan cannot start until it
+// returns.
+typedef uint32_t (*capsense_classifier_t)(const nrf_capsense_features_t *features,
+                                          uint32_t scan_mask,
+                                          uint32_t pressed_mask);
+
+
+// Peripheral resources used by the library. They are claimed in the
+// resource registry (nrf_resource.h) by nrf_capsense_init(), and the
+// TIMER interrupt is dispatched to the library by the registry.
+typedef struct
+{
+    NRF_TIMER_Type *timer;                        // Half period measurement and timeout
+    uint8_t ppi_ch_clear;                         // COMP UP to TIMER CLEAR (fork: guard low)
+    uint8_t ppi_ch_capture;                       // COMP DOWN to TIMER CAPTURE (fork: TIMER STOP)
+    uint8_t ppi_ch_slot;                          // RTC COMPARE to COMP START (fixed slot mode only)
+    uint8_t irq_priority;                         // COMP and TIMER interrupt priority
+} nrf_capsense_resources_t;
+
+
 // Configuration struct. This holds the general configuration of the
 // library.
 typedef struct
 {
     uint32_t analog_pins[CAPSENSE_NUM_BUTTONS];   // Analog input pins
     capsense_callback_t callback;                 // Callback function pointer
+    uint32_t proximity_pin_mask;                  // Pins (index mask) combined for proximity
+    capsense_scan_handler_t scan_handler;         // Scan handler function pointer, or 0
+    capsense_classifier_t classifier;             // Classifier function pointer, or 0
+    nrf_capsense_resources_t resources;           // Peripheral resources, e.g. CAPSENSE_DEFAULT_RESOURCES
 } nrf_capsense_cfg_t;
 
 
+// Self-test result of a channel.
+enum capsense_selftest_status_t {CAPSENSE_SELFTEST_OK,      // Channel is fine
+                                 CAPSENSE_SELFTEST_OPEN,    // Electrode missing or disconnected
+                                 CAPSENSE_SELFTEST_SHORT,   // No oscillation, shorted to supply or ground
+                                 CAPSENSE_SELFTEST_NOISY};  // SNR below CAPSENSE_SELFTEST_MIN_SNR
+
+
+// Self-test report. Baseline and noise are in units of one integrated
+// sample (CAPSENSE_SELFTEST_PERIODS half periods, in 16 MHz ticks).
+// Noise and SNR are fixed point with 4 fractional bits (value x 16).
+typedef struct
+{
+    struct
+    {
+        uint16_t baseline;                        // Mean integrated sample
+        uint16_t noise_q4;                        // Standard deviation x 16
+        uint16_t snr_q4;                          // Reference touch / noise x 16
+        uint8_t  status;                          // enum capsense_selftest_status_t
+    } channel[CAPSENSE_NUM_BUTTONS];
+} nrf_capsense_selftest_report_t;
+
+
+// Timing of the latest button event, in ticks of
+// CAPSENSE_TIMESTAMP_RTC (modulo 2^24). The onset of a channel is the
+// first sample of the run of equal samples that debouncing accepted,
+// so decision_ticks - onset_ticks is the debounce latency of that
+// change.
+typedef struct
+{
+    uint32_t decision_ticks;                      // Debounced decision
+    uint32_t changed_mask;                        // Channels (index mask) that changed state
+    struct
+    {
+        uint32_t onset_ticks;                     // First qualifying sample of the latest change
+        uint32_t duration_ticks;                  // On release, press onset to release onset; else 0
+    } channel[CAPSENSE_NUM_BUTTONS];
+} nrf_capsense_event_info_t;
+
+
+// Runtime tuning. Defaults are taken from nrf_capsense_cfg.h, and can
+// be changed at any time with nrf_capsense_tuning_set().
+typedef struct
+{
+    uint32_t filter_margin;                       // Counts above calibrated average for a press
+    uint32_t debounce_threshold;                  // Consecutive samples needed for a state change
+    uint32_t channel_mask;                        // Channels (index mask) sampled by nrf_capsense_sample()
+    uint32_t proximity_threshold;                 // Counts above proximity baseline for an approach
+} nrf_capsense_tuning_t;
+
+
 // Function to initialize the capsense library. The supplied
 // configuration array must be valid for as long as capsense is used
 // and shall not be changed outside the library after the call to this
-// function.
-void nrf_capsense_init(nrf_capsense_cfg_t *cfg);
+// function. Returns NRF_SUCCESS, NRF_ERROR_INVALID_PARAM if a resource
+// does not exist or is given twice, or NRF_ERROR_BUSY if a resource is
+// already claimed by another driver. May be called again to change the
+// configuration, but not while sampling; the previous configuration is
+// stopped first, and its resources are released once the new ones are
+// claimed. On error nothing new is claimed, and the previous
+// configuration, if any, is set up again.
+uint32_t nrf_capsense_init(nrf_capsense_cfg_t *cfg);
+
+
+// TIMER interrupt handler of the library. The resource registry
+// dispatches the interrupt of the configured TIMER here. When the
+// handler of that TIMER is left out of the registry dispatch
+// (NRF_RESOURCE_TIMER_DISPATCH_MASK), call this from the application's
+// TIMER interrupt handler instead.
+void nrf_capsense_timer_irq_handler(void);
 
 
 // Function to initiate sampling of all the registered capsense
@@ -45,9 +173,111 @@ void nrf_capsense_init(nrf_capsense_cfg_t *cfg);
 //
 // Call regularly from the application in order to sample buttons (use
 // apptimer library or RTC directly).
+//
+// With CAPSENSE_PARTIAL_SCAN_ENABLED only the channels selected by the
+// partial scan scheduler are sampled (see nrf_capsense_cfg.h).
 void nrf_capsense_sample(void);
 
 
+// Function to initiate sampling of a subset of the channels. Only
+// channels in pin_mask (index mask) that are also enabled in the
+// tuning channel_mask are sampled, and only those are debounced. The
+// debounce state of the other enabled channels is left as is.
+void nrf_capsense_sample_mask(uint32_t pin_mask);
+
+
+// Function to initiate a proximity scan. All channels in the
+// proximity_pin_mask of the configuration are sampled as one combined
+// electrode, integrating CAPSENSE_PROXIMITY_INTEGRATION_PERIODS half
+// periods per channel. This is slower than nrf_capsense_sample() but
+// far more sensitive, and is intended to be called at a low rate
+// while waiting for a user to approach. The callback is called with
+// CAPSENSE_PROXIMITY_EVENT whenever the proximity state changes.
+//
+// The proximity baseline is taken from the first proximity scan and
+// then tracks slow changes, so there should be nothing close to the
+// electrodes when the first scan is run. If an approach stays detected
+// for CAPSENSE_PROXIMITY_MAX_DETECTED_SCANS scans, the baseline is
+// taken again from the current scan and the approach is released.
+//
+// Returns NRF_SUCCESS, or NRF_ERROR_INVALID_STATE in fixed slot mode.
+uint32_t nrf_capsense_proximity_sample(void);
+
+
+// Function to forget the proximity state. The detected state is
+// cleared without an event and the baseline is taken again from the
+// next proximity scan. Call when leaving proximity scanning, so that
+// a stale state or baseline is not carried into the next period of
+// proximity scans.
+void nrf_capsense_proximity_reset(void);
+
+
+// Function to change the runtime tuning. The new tuning is copied and
+// takes effect at the start of the next scan, never in the middle of
+// one, so all parameters change together. Calibration data is kept.
+// Channels removed from channel_mask are no longer sampled and are
+// released through the normal debounce. Calibration always covers
+// all channels, so a channel can be enabled again without
+// recalibrating. May be called from any context.
+// Returns NRF_SUCCESS, or NRF_ERROR_INVALID_PARAM if channel_mask holds
+// a channel beyond CAPSENSE_NUM_BUTTONS.
+uint32_t nrf_capsense_tuning_set(const nrf_capsense_tuning_t *tuning);
+
+
+// Function to read the tuning currently in effect (or pending, if
+// nrf_capsense_tuning_set() was called since the last scan started).
+void nrf_capsense_tuning_get(nrf_capsense_tuning_t *tuning);
+
+
+// Function to read the timing of the latest CAPSENSE_BUTTON_EVENT
+// (requires CAPSENSE_TIMESTAMP_ENABLED). Call it from the callback,
+// before the next scan can complete.
+void nrf_capsense_event_info_get(nrf_capsense_event_info_t *info);
+
+
+// Function to run the factory self-test. Every channel is sampled
+// CAPSENSE_SELFTEST_SCANS times at high resolution, and its baseline,
+// noise, SNR and open/short status are written to report. The
+// reference_delta is the expected shift of a single half period for a
+// reference touch on the production fixture, in 16 MHz ticks, and is
+// used for the SNR. A timeout on a channel marks it as shorted and
+// the test continues with the next channel. The callback is called
+// with CAPSENSE_SELFTEST_EVENT when done. The report must stay valid
+// until then. Calibration data is not changed.
+//
+// Returns NRF_SUCCESS, or NRF_ERROR_INVALID_STATE in fixed slot mode.
+uint32_t nrf_capsense_selftest(nrf_capsense_selftest_report_t *report, uint32_t reference_delta);
+
+
+// Function to start sampling in fixed slot mode (requires
+// CAPSENSE_FIXED_SLOT_ENABLED and a running LFCLK). A button scan is
+// started every period_ticks RTC ticks (32768 Hz) by PPI, so that the
+// start of each channel measurement does not depend on interrupt or
+// application timer latency. Constant latency mode is kept on while
+// running. Do not call nrf_capsense_sample() while in this mode, and
+// calibrate before starting it: calibration, self-test and proximity
+// sampling are refused until nrf_capsense_fixed_slot_stop().
+//
+// Returns NRF_SUCCESS, NRF_ERROR_INVALID_PARAM if period_ticks is
+// shorter than the slots of a scan (CAPSENSE_NUM_BUTTONS *
+// CAPSENSE_FIXED_SLOT_TICKS) or not below 2^23, or
+// NRF_ERROR_INVALID_STATE if a calibration, self-test or proximity
+// scan is in progress.
+uint32_t nrf_capsense_fixed_slot_start(uint32_t period_ticks);
+
+
+// Function to stop fixed slot mode. A scan in progress is abandoned.
+void nrf_capsense_fixed_slot_stop(void);
+
+
+// Function to get the guaranteed worst case time, in microseconds,
+// from a touch or release until the CAPSENSE_BUTTON_EVENT callback in
+// fixed slot mode, with the current period and debounce threshold.
+// This is one period for the touch to be first sampled, one period
+// per further debounce sample, plus the slots of the whole scan.
+uint32_t nrf_capsense_fixed_slot_latency_us(void);
+
+
 // Function to calibrate the capacitive sensors. This simple
 // calibration is based on the naive assumption that buttons are never
 // pressed when calibration is run and that the environment never
@@ -55,4 +285,9 @@ void nrf_capsense_sample(void);
 // before used in an end product. (A proper calibration mechanism must
 // be able to properly handle changes in the environment, but not
 // mistake e.g. a very long touch as a change in the environment.)
-void nrf_capsense_calibrate(void);
+//
+// Returns NRF_SUCCESS, or NRF_ERROR_INVALID_STATE in fixed slot mode;
+// stop fixed slot mode first.
+uint32_t nrf_capsense_calibrate(void);
+
+#endif // NRF_CAPSENSE_H__
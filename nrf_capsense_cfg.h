@@ -10,30 +10,236 @@
  *
  */
 
+#ifndef NRF_CAPSENSE_CFG_H__
+#define NRF_CAPSENSE_CFG_H__
+
+// Every setting below can be overridden from the compiler command line
+// (e.g. -DCAPSENSE_NUM_BUTTONS=4).
+
 // Number of sensors used for the Capsense library. The maximum number
 // is 8, limited by the number of analog input pins on the nRF52.
+#ifndef CAPSENSE_NUM_BUTTONS
 #define CAPSENSE_NUM_BUTTONS                      2
+#endif
 
 // The number of consecutive samples indicating the same state
 // (pressed / not pressed) that is required before a action is
 // considered real and teh callback function is called.
+#ifndef CAPSENSE_DEBOUNCE_CONFIDENCE_THRESHOLD
 #define CAPSENSE_DEBOUNCE_CONFIDENCE_THRESHOLD    5
+#endif
+
+// Default peripheral resources (nrf_capsense_resources_t): TIMER1,
+// PPI channels 0, 1 and 2, and interrupt priority 3.
+#ifndef CAPSENSE_DEFAULT_RESOURCES
+#define CAPSENSE_DEFAULT_RESOURCES                {NRF_TIMER1, 0, 1, 2, 3}
+#endif
+
+// Fixed slot mode. Scans are started by an RTC compare event through
+// PPI, without the CPU on the start path, and channel i is always
+// started CAPSENSE_FIXED_SLOT_TICKS * i RTC ticks (32768 Hz) after the
+// scan start. A measurement that does not complete within its slot
+// times out, counts as released and the scan continues. Uses the RTC
+// below and PPI channel ppi_ch_slot. Cannot be combined with
+// CAPSENSE_PARTIAL_SCAN_ENABLED.
+#ifndef CAPSENSE_FIXED_SLOT_ENABLED
+#define CAPSENSE_FIXED_SLOT_ENABLED               0
+#endif
+#ifndef CAPSENSE_FIXED_SLOT_TICKS
+#define CAPSENSE_FIXED_SLOT_TICKS                 2
+#endif
+#ifndef CAPSENSE_RTC
+#define CAPSENSE_RTC                              NRF_RTC2
+#endif
+
+// Driven guard (shield) electrode. When enabled, the guard pin is
+// driven high while the sensed electrode charges and low from its
+// upward crossing. The guard is thus a square wave in step with the
+// oscillator edges, but it does not follow the electrode voltage: it
+// is low during the measured discharge, while the electrode is between
+// the thresholds. It mainly keeps a water film between the electrodes
+// from coupling to a static ground during the charge phase. Uses one
+// GPIOTE channel and the fork of PPI channel ppi_ch_clear.
+#ifndef CAPSENSE_GUARD_ENABLED
+#define CAPSENSE_GUARD_ENABLED                    0
+#endif
+#ifndef CAPSENSE_GUARD_PIN
+#define CAPSENSE_GUARD_PIN                        4
+#endif
+#ifndef CAPSENSE_GUARD_GPIOTE_CH
+#define CAPSENSE_GUARD_GPIOTE_CH                  0
+#endif
+
+// Moisture rejection. A water film shifts all channels by a similar
+// amount and builds up slowly, whereas a finger mainly shifts the
+// channel it touches and lands within a scan or two. When at least
+// CAPSENSE_MOISTURE_MIN_CHANNELS channels are above the calibration
+// margin in the same scan, their shifts differ by no more than
+// CAPSENSE_MOISTURE_MAX_SPREAD, and none of them crossed the margin
+// with a rise of more than CAPSENSE_MOISTURE_MAX_ONSET_STEP in one
+// scan, the panel is considered wet. Touches are then ignored until
+// the signature has been absent for CAPSENSE_MOISTURE_DRY_SCANS
+// consecutive scans. The onset rule is what tells a film from a
+// simultaneous press of all keys, so keep the step above the scan to
+// scan noise and below the shift of a fast touch.
+#ifndef CAPSENSE_MOISTURE_REJECTION_ENABLED
+#define CAPSENSE_MOISTURE_REJECTION_ENABLED       0
+#endif
+#ifndef CAPSENSE_MOISTURE_MIN_CHANNELS
+#define CAPSENSE_MOISTURE_MIN_CHANNELS            CAPSENSE_NUM_BUTTONS
+#endif
+#ifndef CAPSENSE_MOISTURE_MAX_SPREAD
+#define CAPSENSE_MOISTURE_MAX_SPREAD              4
+#endif
+#ifndef CAPSENSE_MOISTURE_MAX_ONSET_STEP
+#define CAPSENSE_MOISTURE_MAX_ONSET_STEP          5
+#endif
+#ifndef CAPSENSE_MOISTURE_DRY_SCANS
+#define CAPSENSE_MOISTURE_DRY_SCANS               50
+#endif
+
+// Proximity detection configuration. Each electrode taking part in a
+// proximity scan is sampled this many times, and the half periods of
+// all electrodes are summed into one proximity value. The baseline
+// follows the proximity value slowly (1/2^shift per scan) as long as
+// no approach is detected. An approach detected for
+// CAPSENSE_PROXIMITY_MAX_DETECTED_SCANS consecutive proximity scans is
+// released and the baseline restarted.
+#ifndef CAPSENSE_PROXIMITY_INTEGRATION_PERIODS
+#define CAPSENSE_PROXIMITY_INTEGRATION_PERIODS    16
+#endif
+#ifndef CAPSENSE_PROXIMITY_THRESHOLD
+#define CAPSENSE_PROXIMITY_THRESHOLD              64
+#endif
+#ifndef CAPSENSE_PROXIMITY_BASELINE_SHIFT
+#define CAPSENSE_PROXIMITY_BASELINE_SHIFT         4
+#endif
+#ifndef CAPSENSE_PROXIMITY_MAX_DETECTED_SCANS
+#define CAPSENSE_PROXIMITY_MAX_DETECTED_SCANS     300
+#endif
 
-// Define the timer that is used by the capsense library.
-#define CAPSENSE_TIMER                            NRF_TIMER1
-#define CAPSENSE_TIMER_IRQ                        TIMER1_IRQn
-#define CAPSENSE_TIMER_IRQHandler                 TIMER1_IRQHandler
+// Partial scan. When enabled, nrf_capsense_sample() does not sample
+// every channel on each call. Active channels (pressed, or with a
+// press being debounced) and their neighbours in the analog_pins
+// order are sampled on every scan. Of the remaining channels,
+// CAPSENSE_PARTIAL_SCAN_IDLE_CHANNELS are sampled per scan in round
+// robin order. This reduces scan time for large panels at the cost of
+// a higher press latency on idle channels. With
+// CAPSENSE_MOISTURE_REJECTION_ENABLED, every channel is sampled while
+// any channel is active or the panel is wet, as a film can only be
+// told from touches on a full scan.
+#ifndef CAPSENSE_PARTIAL_SCAN_ENABLED
+#define CAPSENSE_PARTIAL_SCAN_ENABLED             0
+#endif
+#ifndef CAPSENSE_PARTIAL_SCAN_IDLE_CHANNELS
+#define CAPSENSE_PARTIAL_SCAN_IDLE_CHANNELS       1
+#endif
 
-// PPI channel assignment for the capsense library.
-#define CAPSENSE_PPI_CH0                          0
-#define CAPSENSE_PPI_CH1                          1
+// Factory self-test configuration. Each channel is sampled
+// CAPSENSE_SELFTEST_SCANS times, each sample integrating
+// CAPSENSE_SELFTEST_PERIODS half periods. A channel is reported open
+// if its mean half period is below CAPSENSE_SELFTEST_OPEN_COUNTS (only
+// the pad capacitance is seen), and noisy if the SNR against the
+// reference touch is below CAPSENSE_SELFTEST_MIN_SNR.
+#ifndef CAPSENSE_SELFTEST_SCANS
+#define CAPSENSE_SELFTEST_SCANS                   32
+#endif
+#ifndef CAPSENSE_SELFTEST_PERIODS
+#define CAPSENSE_SELFTEST_PERIODS                 4
+#endif
+#ifndef CAPSENSE_SELFTEST_OPEN_COUNTS
+#define CAPSENSE_SELFTEST_OPEN_COUNTS             20
+#endif
+#ifndef CAPSENSE_SELFTEST_MIN_SNR
+#define CAPSENSE_SELFTEST_MIN_SNR                 5
+#endif
+
+// Telemetry encoder configuration (nrf_capsense_telemetry.c). Size of
+// the frame buffer in bytes (power of two), and the number of frames
+// between key frames, which carry absolute values instead of deltas
+// and let a decoder resynchronize.
+#ifndef CAPSENSE_TELEMETRY_BUFFER_SIZE
+#define CAPSENSE_TELEMETRY_BUFFER_SIZE            1024
+#endif
+#ifndef CAPSENSE_TELEMETRY_KEY_INTERVAL
+#define CAPSENSE_TELEMETRY_KEY_INTERVAL           64
+#endif
+
+// Feature vector (nrf_capsense_features_t). The energy feature is a
+// running mean over about 2^CAPSENSE_FEATURE_ENERGY_SHIFT scans.
+#ifndef CAPSENSE_FEATURE_ENERGY_SHIFT
+#define CAPSENSE_FEATURE_ENERGY_SHIFT             2
+#endif
+
+// Temperature and supply compensation. When enabled, the die
+// temperature (TEMP) and the supply voltage (SAADC, VDD input) are
+// read every CAPSENSE_COMPENSATION_INTERVAL scans, and the baseline of
+// each channel is corrected with coefficients learned from the change
+// in calibrated average between calibrations. A calibration teaches
+// the temperature coefficient when the temperature has moved by at
+// least CAPSENSE_COMPENSATION_MIN_TEMP_DELTA (0.25 degC units) and the
+// supply has not, and the supply coefficient in the opposite case
+// (CAPSENSE_COMPENSATION_MIN_VDD_DELTA, in SAADC LSB of 3.6 V / 1024).
+// The conversions are started at the start of a scan and collected at
+// the start of the following scans, so no scan waits for them. The
+// SAADC must not be in use by the application while capsense samples.
+#ifndef CAPSENSE_COMPENSATION_ENABLED
+#define CAPSENSE_COMPENSATION_ENABLED             0
+#endif
+#ifndef CAPSENSE_COMPENSATION_INTERVAL
+#define CAPSENSE_COMPENSATION_INTERVAL            100
+#endif
+#ifndef CAPSENSE_COMPENSATION_MIN_TEMP_DELTA
+#define CAPSENSE_COMPENSATION_MIN_TEMP_DELTA      20
+#endif
+#ifndef CAPSENSE_COMPENSATION_MIN_VDD_DELTA
+#define CAPSENSE_COMPENSATION_MIN_VDD_DELTA       15
+#endif
+
+// Comparator auto-select. When enabled, nrf_capsense_calibrate()
+// first sweeps a table of comparator current source, threshold and
+// speed settings on every channel, measuring each
+// CAPSENSE_COMP_AUTOSELECT_SAMPLES times. Each channel then uses the
+// setting with the shortest half period that still reaches
+// CAPSENSE_COMP_AUTOSELECT_TARGET_COUNTS (or the longest, if none
+// does), and calibration runs with the selected settings.
+#ifndef CAPSENSE_COMP_AUTOSELECT_ENABLED
+#define CAPSENSE_COMP_AUTOSELECT_ENABLED          0
+#endif
+#ifndef CAPSENSE_COMP_AUTOSELECT_TARGET_COUNTS
+#define CAPSENSE_COMP_AUTOSELECT_TARGET_COUNTS    100
+#endif
+#ifndef CAPSENSE_COMP_AUTOSELECT_SAMPLES
+#define CAPSENSE_COMP_AUTOSELECT_SAMPLES          4
+#endif
+
+// Event timestamps. When enabled, every sample is timestamped with the
+// COUNTER of the RTC below, and nrf_capsense_event_info_get() reports
+// when a button change was first seen and when it was decided. The
+// RTC must be running (the example uses the app_timer RTC); the
+// library only reads it. Timestamps are in ticks of that RTC, modulo
+// 2^24.
+#ifndef CAPSENSE_TIMESTAMP_ENABLED
+#define CAPSENSE_TIMESTAMP_ENABLED                0
+#endif
+#ifndef CAPSENSE_TIMESTAMP_RTC
+#define CAPSENSE_TIMESTAMP_RTC                    NRF_RTC1
+#endif
 
 // Calibration filter configuration.
+#ifndef CAPSENSE_CALIBRATION_FILTER_MARGIN
 #define CAPSENSE_CALIBRATION_FILTER_MARGIN        3
+#endif
+#ifndef CAPSENSE_CALIBRATION_RUNS
 #define CAPSENSE_CALIBRATION_RUNS                 25
+#endif
 
 // Always use constant latency mode. The library will use constant
 // latency mode while sampling. Normall it will be disabled after
 // sampling, but if this define is set to non-null, keep constant
 // latency mode.
+#ifndef CAPSENSE_ALWAYS_CONSTANT_LATENCY
 #define CAPSENSE_ALWAYS_CONSTANT_LATENCY          0
+#endif
+
+#endif // NRF_CAPSENSE_CFG_H__
@@ -0,0 +1,176 @@
+/* Copyright (c) 2016 Nordic Semiconductor. All Rights Reserved.
+ *
+ * The information contained herein is property of Nordic Semiconductor ASA.
+ * Terms and conditions of usage are described in detail in NORDIC
+ * SEMICONDUCTOR STANDARD SOFTWARE LICENSE AGREEMENT.
+ *
+ * Licensees are granted free, non-transferable use of the information. NO
+ * WARRANTY of ANY KIND is provided. This heading must NOT be removed from
+ * the file.
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "nrf_capsense_telemetry.h"
+#include "nrf_capsense_cfg.h"
+
+#if (CAPSENSE_TELEMETRY_BUFFER_SIZE & (CAPSENSE_TELEMETRY_BUFFER_SIZE - 1)) != 0
+#error "CAPSENSE_TELEMETRY_BUFFER_SIZE must be a power of two"
+#endif
+
+#define BUFFER_MASK                     (CAPSENSE_TELEMETRY_BUFFER_SIZE - 1)
+
+
+// The buffer is written only from the scan handler and read only by
+// nrf_capsense_telemetry_read(). Each index is only written by one
+// side, so no locking is needed.
+static uint8_t m_buffer[CAPSENSE_TELEMETRY_BUFFER_SIZE];
+static volatile uint32_t m_write_index = 0;
+static volatile uint32_t m_read_index = 0;
+static uint32_t m_prev_sample[CAPSENSE_NUM_BUTTONS];
+static uint8_t m_seq = 0;
+static uint32_t m_frames_since_key = 0;
+static bool m_force_key = true;
+static uint32_t m_dropped = 0;
+
+
+uint8_t nrf_capsense_telemetry_crc8(const uint8_t *data, uint32_t length)
+{
+    uint8_t crc = 0;
+
+    for (uint32_t i = 0; i < length; i++)
+    {
+        crc ^= data[i];
+        for (unsigned int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+        }
+    }
+
+    return crc;
+}
+
+
+static uint32_t varint_put(uint8_t *buf, uint32_t value)
+{
+    uint32_t length = 0;
+
+    while (value >= 0x80)
+    {
+        buf[length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    buf[length++] = (uint8_t)value;
+
+    return length;
+}
+
+
+uint32_t nrf_capsense_telemetry_encode(const uint32_t *samples, uint32_t scan_mask, uint8_t *buf)
+{
+    bool key = m_force_key || (m_frames_since_key >= CAPSENSE_TELEMETRY_KEY_INTERVAL);
+    uint32_t length = 5;
+
+    scan_mask &= (1UL << CAPSENSE_NUM_BUTTONS) - 1;
+
+    buf[0] = CAPSENSE_TELEMETRY_SYNC;
+    buf[2] = m_seq++;
+    buf[3] = key ? CAPSENSE_TELEMETRY_FLAG_KEY : 0;
+    buf[4] = (uint8_t)scan_mask;
+
+    for (unsigned int i = 0; i < CAPSENSE_NUM_BUTTONS; i++)
+    {
+        if ((scan_mask & (1 << i)) == 0)
+        {
+            continue;
+        }
+
+        if (key)
+        {
+            length += varint_put(&buf[length], samples[i]);
+        }
+        else
+        {
+            int32_t delta = (int32_t)(samples[i] - m_prev_sample[i]);
+            // Zigzag, so that small negative deltas stay short
+            length += varint_put(&buf[length], ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31));
+        }
+        m_prev_sample[i] = samples[i];
+    }
+
+    // A key frame must hold every channel, or the decoder cannot
+    // resynchronize the ones left out.
+    if (key && (scan_mask == (1UL << CAPSENSE_NUM_BUTTONS) - 1))
+    {
+        m_force_key = false;
+        m_frames_since_key = 0;
+    }
+    else
+    {
+        m_frames_since_key++;
+    }
+
+    buf[1] = (uint8_t)(length - 2);
+    buf[length] = nrf_capsense_telemetry_crc8(&buf[1], length - 1);
+
+    return length + 1;
+}
+
+
+void nrf_capsense_telemetry_scan_handler(const uint32_t *samples, uint32_t scan_mask)
+{
+    uint8_t frame[CAPSENSE_TELEMETRY_MAX_FRAME];
+    uint32_t write_index = m_write_index;
+    uint32_t free_space = CAPSENSE_TELEMETRY_BUFFER_SIZE - (write_index - m_read_index);
+    uint32_t length;
+
+    if (free_space < CAPSENSE_TELEMETRY_MAX_FRAME)
+    {
+        // Drop the frame. The next one will be a key frame.
+        m_dropped++;
+        m_seq++;
+        m_force_key = true;
+        return;
+    }
+
+    length = nrf_capsense_telemetry_encode(samples, scan_mask, frame);
+    for (uint32_t i = 0; i < length; i++)
+    {
+        m_buffer[(write_index + i) & BUFFER_MASK] = frame[i];
+    }
+    m_write_index = write_index + length;
+}
+
+
+uint32_t nrf_capsense_telemetry_read(uint8_t *buf, uint32_t size)
+{
+    uint32_t read_index = m_read_index;
+    uint32_t available = m_write_index - read_index;
+    uint32_t length = (available < size) ? available : size;
+
+    for (uint32_t i = 0; i < length; i++)
+    {
+        buf[i] = m_buffer[(read_index + i) & BUFFER_MASK];
+    }
+    m_read_index = read_index + length;
+
+    return length;
+}
+
+
+uint32_t nrf_capsense_telemetry_dropped(void)
+{
+    return m_dropped;
+}
+
+
+void nrf_capsense_telemetry_init(void)
+{
+    m_write_index = 0;
+    m_read_index = 0;
+    m_seq = 0;
+    m_frames_since_key = 0;
+    m_force_key = true;
+    m_dropped = 0;
+}
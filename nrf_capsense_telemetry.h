@@ -0,0 +1,74 @@
+/* Copyright (c) 2016 Nordic Semiconductor. All Rights Reserved.
+ *
+ * The information contained herein is property of Nordic Semiconductor ASA.
+ * Terms and conditions of usage are described in detail in NORDIC
+ * SEMICONDUCTOR STANDARD SOFTWARE LICENSE AGREEMENT.
+ *
+ * Licensees are granted free, non-transferable use of the information. NO
+ * WARRANTY of ANY KIND is provided. This heading must NOT be removed from
+ * the file.
+ *
+ */
+
+#ifndef NRF_CAPSENSE_TELEMETRY_H__
+#define NRF_CAPSENSE_TELEMETRY_H__
+
+#include <stdint.h>
+#include "nrf_capsense_cfg.h"
+
+// Binary telemetry of raw capsense samples. Each scan is encoded into
+// one frame in a buffer from the scan handler (interrupt context),
+// and the application drains the buffer from thread context to RTT,
+// UART or similar. Frame layout:
+//
+//   0xA5  sync
+//   len   number of bytes from seq up to (not including) crc
+//   seq   frame sequence number, incremented for every frame
+//   flags bit 0: key frame (absolute values instead of deltas)
+//   mask  channels (index mask) present in the frame
+//   data  one varint per channel in mask, in index order. Key frames
+//         hold the sample; other frames hold the zigzag encoded
+//         difference to the previous sample of the same channel.
+//   crc   CRC-8 (polynomial 0x07) over len up to the end of data
+//
+// When the buffer is full the frame is dropped and the next frame is
+// made a key frame, so that a decoder seeing a sequence gap can
+// resynchronize from it.
+
+#define CAPSENSE_TELEMETRY_SYNC         0xA5
+#define CAPSENSE_TELEMETRY_FLAG_KEY     0x01
+
+// Largest possible frame: header, five byte varint per channel, crc.
+#define CAPSENSE_TELEMETRY_MAX_FRAME    (5 + 5 * CAPSENSE_NUM_BUTTONS + 1)
+
+
+// Function to reset the encoder and empty the buffer.
+void nrf_capsense_telemetry_init(void);
+
+
+// Scan handler that encodes one frame. Set it as scan_handler in the
+// capsense configuration, or call it from the application's own scan
+// handler.
+void nrf_capsense_telemetry_scan_handler(const uint32_t *samples, uint32_t scan_mask);
+
+
+// Function to encode one frame into a caller supplied buffer, without
+// using the internal frame buffer. Returns the frame length. buf must
+// hold at least CAPSENSE_TELEMETRY_MAX_FRAME bytes.
+uint32_t nrf_capsense_telemetry_encode(const uint32_t *samples, uint32_t scan_mask, uint8_t *buf);
+
+
+// Function to read encoded data from the buffer. Returns the number of
+// bytes copied to buf, at most size. Call from a single context only.
+uint32_t nrf_capsense_telemetry_read(uint8_t *buf, uint32_t size);
+
+
+// Function to get the number of frames dropped because the buffer was
+// full.
+uint32_t nrf_capsense_telemetry_dropped(void);
+
+
+// Function to compute the frame CRC. Shared with the host decoder.
+uint8_t nrf_capsense_telemetry_crc8(const uint8_t *data, uint32_t length);
+
+#endif // NRF_CAPSENSE_TELEMETRY_H__
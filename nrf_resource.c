@@ -0,0 +1,249 @@
+/* Copyright (c) 2016 Nordic Semiconductor. All Rights Reserved.
+ *
+ * The information contained herein is property of Nordic Semiconductor ASA.
+ * Terms and conditions of usage are described in detail in NORDIC
+ * SEMICONDUCTOR STANDARD SOFTWARE LICENSE AGREEMENT.
+ *
+ * Licensees are granted free, non-transferable use of the information. NO
+ * WARRANTY of ANY KIND is provided. This heading must NOT be removed from
+ * the file.
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "nrf.h"
+#include "nrf_error.h"
+#include "nrf_resource.h"
+
+
+#define TIMER_COUNT             5
+#define RTC_COUNT               3
+#define PPI_CHANNEL_COUNT       20
+#define GPIOTE_CHANNEL_COUNT    8
+#define COMP_COUNT              1
+
+#define RESOURCE_COUNT          (TIMER_COUNT + RTC_COUNT + PPI_CHANNEL_COUNT + GPIOTE_CHANNEL_COUNT + COMP_COUNT)
+
+
+// Number of resources of each type, and where they start in m_owner
+static const uint8_t m_type_count[NRF_RESOURCE_TYPE_COUNT] =
+{
+    TIMER_COUNT, RTC_COUNT, PPI_CHANNEL_COUNT, GPIOTE_CHANNEL_COUNT, COMP_COUNT
+};
+static const uint8_t m_type_offset[NRF_RESOURCE_TYPE_COUNT] =
+{
+    0,
+    TIMER_COUNT,
+    TIMER_COUNT + RTC_COUNT,
+    TIMER_COUNT + RTC_COUNT + PPI_CHANNEL_COUNT,
+    TIMER_COUNT + RTC_COUNT + PPI_CHANNEL_COUNT + GPIOTE_CHANNEL_COUNT
+};
+
+static NRF_TIMER_Type * const m_timers[TIMER_COUNT] =
+{
+    NRF_TIMER0, NRF_TIMER1, NRF_TIMER2, NRF_TIMER3, NRF_TIMER4
+};
+static const IRQn_Type m_timer_irqn[TIMER_COUNT] =
+{
+    TIMER0_IRQn, TIMER1_IRQn, TIMER2_IRQn, TIMER3_IRQn, TIMER4_IRQn
+};
+static NRF_RTC_Type * const m_rtcs[RTC_COUNT] =
+{
+    NRF_RTC0, NRF_RTC1, NRF_RTC2
+};
+
+static const char *m_owner[RESOURCE_COUNT];
+static volatile nrf_resource_irq_handler_t m_timer_handler[TIMER_COUNT];
+
+
+static bool resource_exists(nrf_resource_type_t type, uint32_t index)
+{
+    return (type < NRF_RESOURCE_TYPE_COUNT) && (index < m_type_count[type]);
+}
+
+
+uint32_t nrf_resource_claim(nrf_resource_type_t type, uint32_t index, const char *owner)
+{
+    uint32_t err_code = NRF_SUCCESS;
+
+    if (!resource_exists(type, index) || (owner == 0))
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (m_owner[m_type_offset[type] + index] != 0)
+    {
+        err_code = NRF_ERROR_BUSY;
+    }
+    else
+    {
+        m_owner[m_type_offset[type] + index] = owner;
+    }
+    __set_PRIMASK(primask);
+
+    return err_code;
+}
+
+
+uint32_t nrf_resource_release(nrf_resource_type_t type, uint32_t index, const char *owner)
+{
+    uint32_t err_code = NRF_SUCCESS;
+
+    if (!resource_exists(type, index))
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if ((owner == 0) || (m_owner[m_type_offset[type] + index] != owner))
+    {
+        err_code = NRF_ERROR_BUSY;
+    }
+    else
+    {
+        if (type == NRF_RESOURCE_TIMER)
+        {
+            m_timer_handler[index] = 0;
+        }
+        m_owner[m_type_offset[type] + index] = 0;
+    }
+    __set_PRIMASK(primask);
+
+    return err_code;
+}
+
+
+void nrf_resource_release_all(const char *owner)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    for (unsigned int i = 0; i < TIMER_COUNT; i++)
+    {
+        if (m_owner[m_type_offset[NRF_RESOURCE_TIMER] + i] == owner)
+        {
+            m_timer_handler[i] = 0;
+        }
+    }
+    for (unsigned int i = 0; i < RESOURCE_COUNT; i++)
+    {
+        if (m_owner[i] == owner)
+        {
+            m_owner[i] = 0;
+        }
+    }
+    __set_PRIMASK(primask);
+}
+
+
+const char *nrf_resource_owner(nrf_resource_type_t type, uint32_t index)
+{
+    return resource_exists(type, index) ? m_owner[m_type_offset[type] + index] : 0;
+}
+
+
+uint32_t nrf_resource_index(nrf_resource_type_t type, const void *instance, uint32_t *index)
+{
+    for (uint32_t i = 0; i < TIMER_COUNT; i++)
+    {
+        if ((type == NRF_RESOURCE_TIMER) && (instance == m_timers[i]))
+        {
+            *index = i;
+            return NRF_SUCCESS;
+        }
+    }
+    for (uint32_t i = 0; i < RTC_COUNT; i++)
+    {
+        if ((type == NRF_RESOURCE_RTC) && (instance == m_rtcs[i]))
+        {
+            *index = i;
+            return NRF_SUCCESS;
+        }
+    }
+
+    return NRF_ERROR_INVALID_PARAM;
+}
+
+
+IRQn_Type nrf_resource_timer_irqn(uint32_t index)
+{
+    return m_timer_irqn[index];
+}
+
+
+bool nrf_resource_timer_dispatched(uint32_t index)
+{
+    return (index < TIMER_COUNT) && ((NRF_RESOURCE_TIMER_DISPATCH_MASK & (1 << index)) != 0);
+}
+
+
+uint32_t nrf_resource_timer_handler_set(uint32_t index, nrf_resource_irq_handler_t handler, const char *owner)
+{
+    if (!nrf_resource_timer_dispatched(index))
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    if ((owner == 0) || (nrf_resource_owner(NRF_RESOURCE_TIMER, index) != owner))
+    {
+        return NRF_ERROR_BUSY;
+    }
+
+    m_timer_handler[index] = handler;
+    return NRF_SUCCESS;
+}
+
+
+#if NRF_RESOURCE_TIMER_DISPATCH_MASK
+static void timer_dispatch(uint32_t index)
+{
+    nrf_resource_irq_handler_t handler = m_timer_handler[index];
+
+    if (handler)
+    {
+        handler();
+    }
+}
+#endif
+
+
+#if NRF_RESOURCE_TIMER_DISPATCH_MASK & (1 << 0)
+void TIMER0_IRQHandler(void)
+{
+    timer_dispatch(0);
+}
+#endif
+
+
+#if NRF_RESOURCE_TIMER_DISPATCH_MASK & (1 << 1)
+void TIMER1_IRQHandler(void)
+{
+    timer_dispatch(1);
+}
+#endif
+
+
+#if NRF_RESOURCE_TIMER_DISPATCH_MASK & (1 << 2)
+void TIMER2_IRQHandler(void)
+{
+    timer_dispatch(2);
+}
+#endif
+
+
+#if NRF_RESOURCE_TIMER_DISPATCH_MASK & (1 << 3)
+void TIMER3_IRQHandler(void)
+{
+    timer_dispatch(3);
+}
+#endif
+
+
+#if NRF_RESOURCE_TIMER_DISPATCH_MASK & (1 << 4)
+void TIMER4_IRQHandler(void)
+{
+    timer_dispatch(4);
+}
+#endif
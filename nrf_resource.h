@@ -0,0 +1,103 @@
+/* Copyright (c) 2016 Nordic Semiconductor. All Rights Reserved.
+ *
+ * The information contained herein is property of Nordic Semiconductor ASA.
+ * Terms and conditions of usage are described in detail in NORDIC
+ * SEMICONDUCTOR STANDARD SOFTWARE LICENSE AGREEMENT.
+ *
+ * Licensees are granted free, non-transferable use of the information. NO
+ * WARRANTY of ANY KIND is provided. This heading must NOT be removed from
+ * the file.
+ *
+ */
+
+#ifndef NRF_RESOURCE_H__
+#define NRF_RESOURCE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "nrf.h"
+
+// Registry of peripheral resources shared between drivers. Each driver
+// claims the resources it is configured to use when it is initialized,
+// so that two drivers given the same TIMER or PPI channel fail at init
+// instead of corrupting each other at run time. Resources used by code
+// that does not claim them (e.g. app_timer) can be claimed on its
+// behalf by the application before other drivers are initialized.
+//
+// The registry can also own TIMER interrupt handlers, and dispatch each
+// TIMER interrupt to the handler set by the owner of that TIMER. Only
+// the handlers of the TIMER instances in
+// NRF_RESOURCE_TIMER_DISPATCH_MASK (bit n for TIMERn) are defined, so
+// that TIMERs driven by e.g. nrf_drv_timer still link. The default is
+// none; the project defines the mask for the TIMERs of its drivers
+// that use dispatch.
+
+
+#ifndef NRF_RESOURCE_TIMER_DISPATCH_MASK
+#define NRF_RESOURCE_TIMER_DISPATCH_MASK    0
+#endif
+
+
+// Resource type. Resources are identified by type and index.
+typedef enum
+{
+    NRF_RESOURCE_TIMER,                     // TIMER instance
+    NRF_RESOURCE_RTC,                       // RTC instance
+    NRF_RESOURCE_PPI_CHANNEL,               // Programmable PPI channel (and its fork)
+    NRF_RESOURCE_GPIOTE_CHANNEL,            // GPIOTE channel
+    NRF_RESOURCE_COMP,                      // COMP / LPCOMP (shared peripheral), index 0
+    NRF_RESOURCE_TYPE_COUNT
+} nrf_resource_type_t;
+
+
+// Interrupt handler of a TIMER owner.
+typedef void (*nrf_resource_irq_handler_t)(void);
+
+
+// Function to claim a resource for owner. Returns NRF_SUCCESS,
+// NRF_ERROR_INVALID_PARAM if the resource does not exist, or
+// NRF_ERROR_BUSY if it is already claimed (by any owner, including
+// this one). May be called from any context.
+uint32_t nrf_resource_claim(nrf_resource_type_t type, uint32_t index, const char *owner);
+
+
+// Function to release a resource claimed by owner, and clear the TIMER
+// interrupt handler it has set. Returns NRF_SUCCESS,
+// NRF_ERROR_INVALID_PARAM if the resource does not exist, or
+// NRF_ERROR_BUSY if it is not claimed by owner.
+uint32_t nrf_resource_release(nrf_resource_type_t type, uint32_t index, const char *owner);
+
+
+// Function to release every resource claimed by owner, and clear the
+// TIMER interrupt handlers it has set.
+void nrf_resource_release_all(const char *owner);
+
+
+// Function to get the owner of a resource, or 0 if it is free or does
+// not exist.
+const char *nrf_resource_owner(nrf_resource_type_t type, uint32_t index);
+
+
+// Function to find the index of a TIMER or RTC instance. Returns
+// NRF_SUCCESS, or NRF_ERROR_INVALID_PARAM if instance is not a
+// peripheral of that type.
+uint32_t nrf_resource_index(nrf_resource_type_t type, const void *instance, uint32_t *index);
+
+
+// Function to get the interrupt number of a TIMER instance.
+IRQn_Type nrf_resource_timer_irqn(uint32_t index);
+
+
+// Function to check if the interrupt of a TIMER instance is dispatched
+// by the registry (NRF_RESOURCE_TIMER_DISPATCH_MASK). If not, its owner
+// must call its handler from the TIMER interrupt handler itself.
+bool nrf_resource_timer_dispatched(uint32_t index);
+
+
+// Function to set the handler the TIMER interrupt is dispatched to.
+// The TIMER must be claimed by owner. Returns NRF_SUCCESS,
+// NRF_ERROR_INVALID_PARAM if the TIMER does not exist or has no
+// dispatch, or NRF_ERROR_BUSY if it is not claimed by owner.
+uint32_t nrf_resource_timer_handler_set(uint32_t index, nrf_resource_irq_handler_t handler, const char *owner);
+
+#endif // NRF_RESOURCE_H__
@@ -0,0 +1,332 @@
+/* Copyright (c) 2016 Nordic Semiconductor. All Rights Reserved.
+ *
+ * The information contained herein is property of Nordic Semiconductor ASA.
+ * Terms and conditions of usage are described in detail in NORDIC
+ * SEMICONDUCTOR STANDARD SOFTWARE LICENSE AGREEMENT.
+ *
+ * Licensees are granted free, non-transferable use of the information. NO
+ * WARRANTY of ANY KIND is provided. This heading must NOT be removed from
+ * the file.
+ *
+ */
+
+// Benchmark of the capsense library against synthetic sensor models.
+//
+// The noise model gives each channel a fixed baseline with gaussian
+// noise and rare impulse spikes. The touch model adds a finger on one
+// random channel at a time, ramping in over a few scans. Four
+// figures are reported for the configuration the tool was built with:
+//
+// - Press latency: scans (and ms) from touch onset until the
+//   CAPSENSE_BUTTON_EVENT reporting that channel pressed, as
+//   percentiles over all touches, plus the number of missed touches.
+// - False positives per hour: presses reported on a noise-only input.
+// - CPU cost: host time spent in the library per scan. This is only
+//   meaningful relative to other configurations and algorithm
+//   versions measured on the same host.
+// - Measurements per scan: channels actually sampled per scan, which
+//   scales scan time and HFCLK on time on target.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "capsense_host.h"
+#include "nrf_error.h"
+#include "nrf_capsense.h"
+#include "nrf_capsense_cfg.h"
+
+
+#define SCAN_INTERVAL_MS        10
+#define BASELINE_COUNTS         100
+#define SPIKE_COUNTS            10
+#define TOUCH_RAMP_SCANS        2
+#define CHUNK_SCANS             4096
+
+
+typedef struct
+{
+    double   noise_sigma;       // Gaussian noise, counts
+    double   spike_rate;        // Impulse probability per channel sample
+    uint32_t touch_min;         // Touch amplitude range, counts
+    uint32_t touch_max;
+    uint32_t touches;           // Number of touches for latency
+    double   hours;             // Noise-only time for false positives
+    uint64_t seed;
+} bench_params_t;
+
+
+static uint64_t m_rng_state;
+static uint32_t m_scan;
+static uint32_t m_prev_pin_mask;
+static uint32_t m_press_count;
+static uint32_t m_press_scan[CAPSENSE_NUM_BUTTONS];
+
+
+static uint32_t rng_next(void)
+{
+    // xorshift64*
+    m_rng_state ^= m_rng_state >> 12;
+    m_rng_state ^= m_rng_state << 25;
+    m_rng_state ^= m_rng_state >> 27;
+    return (uint32_t)((m_rng_state * 2685821657736338717ULL) >> 32);
+}
+
+
+static double rng_uniform(void)
+{
+    return (rng_next() + 0.5) / 4294967296.0;
+}
+
+
+static double rng_gaussian(void)
+{
+    return sqrt(-2.0 * log(rng_uniform())) * cos(2.0 * M_PI * rng_uniform());
+}
+
+
+static uint32_t rng_range(uint32_t min, uint32_t max)
+{
+    return min + rng_next() % (max - min + 1);
+}
+
+
+static void capsense_event_handler(enum capsense_event_t event, uint32_t pin_mask)
+{
+    if (event == CAPSENSE_BUTTON_EVENT)
+    {
+        uint32_t new_presses = pin_mask & ~m_prev_pin_mask;
+
+        for (unsigned int i = 0; i < CAPSENSE_NUM_BUTTONS; i++)
+        {
+            if (new_presses & (1 << i))
+            {
+                m_press_scan[i] = m_scan;
+                m_press_count++;
+            }
+        }
+        m_prev_pin_mask = pin_mask;
+    }
+}
+
+
+// Generate the counts of one scan. touch_delta is added to channel
+// touch_channel.
+static void model_scan(const bench_params_t *p, uint32_t *counts,
+                       unsigned int touch_channel, uint32_t touch_delta)
+{
+    for (unsigned int i = 0; i < CAPSENSE_NUM_BUTTONS; i++)
+    {
+        double value = BASELINE_COUNTS + p->noise_sigma * rng_gaussian();
+
+        if (rng_uniform() < p->spike_rate)
+        {
+            value += SPIKE_COUNTS;
+        }
+        if (i == touch_channel)
+        {
+            value += touch_delta;
+        }
+        counts[i] = value < 1.0 ? 1 : (uint32_t)lround(value);
+    }
+}
+
+
+static void run_scan(const uint32_t *counts)
+{
+    nrf_capsense_sample();
+    capsense_host_feed(counts);
+    m_scan++;
+}
+
+
+static void calibrate(const bench_params_t *p)
+{
+    uint32_t counts[CAPSENSE_NUM_BUTTONS];
+
+    nrf_capsense_calibrate();
+    while (capsense_host_pending())
+    {
+        // Calibration assumes no spikes, as it does on target
+        for (unsigned int i = 0; i < CAPSENSE_NUM_BUTTONS; i++)
+        {
+            counts[i] = (uint32_t)lround(BASELINE_COUNTS + p->noise_sigma * rng_gaussian());
+        }
+        capsense_host_feed(counts);
+    }
+}
+
+
+static int compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+
+static uint32_t percentile(const uint32_t *sorted, uint32_t n, uint32_t pct)
+{
+    return (n == 0) ? 0 : sorted[((n - 1) * pct) / 100];
+}
+
+
+static void bench_latency(const bench_params_t *p, uint32_t *latencies, uint32_t *count, uint32_t *misses)
+{
+    uint32_t counts[CAPSENSE_NUM_BUTTONS];
+
+    *count = 0;
+    *misses = 0;
+
+    for (uint32_t t = 0; t < p->touches; t++)
+    {
+        unsigned int channel = rng_range(0, CAPSENSE_NUM_BUTTONS - 1);
+        uint32_t amplitude = rng_range(p->touch_min, p->touch_max);
+        uint32_t idle = rng_range(20, 50);
+        uint32_t duration = rng_range(30, 60);
+        uint32_t onset;
+
+        for (uint32_t s = 0; s < idle; s++)
+        {
+            model_scan(p, counts, CAPSENSE_NUM_BUTTONS, 0);
+            run_scan(counts);
+        }
+
+        onset = m_scan;
+        m_press_scan[channel] = 0;
+        for (uint32_t s = 0; s < duration; s++)
+        {
+            uint32_t delta = (s < TOUCH_RAMP_SCANS) ? (amplitude * (s + 1)) / (TOUCH_RAMP_SCANS + 1) : amplitude;
+
+            model_scan(p, counts, channel, delta);
+            run_scan(counts);
+        }
+
+        if (m_press_scan[channel] >= onset)
+        {
+            // m_press_scan is the index of the scan that triggered
+            latencies[(*count)++] = m_press_scan[channel] - onset + 1;
+        }
+        else
+        {
+            (*misses)++;
+        }
+    }
+}
+
+
+static void bench_noise(const bench_params_t *p, double *false_per_hour, double *ns_per_scan,
+                        double *measurements_per_scan)
+{
+    static uint32_t chunk[CHUNK_SCANS][CAPSENSE_NUM_BUTTONS];
+    uint64_t total_scans = (uint64_t)(p->hours * 3600.0 * 1000.0 / SCAN_INTERVAL_MS);
+    uint64_t done = 0;
+    double elapsed_ns = 0;
+    uint32_t start_presses = m_press_count;
+    uint64_t start_measurements = capsense_host_measurements();
+
+    while (done < total_scans)
+    {
+        uint32_t n = (total_scans - done) < CHUNK_SCANS ? (uint32_t)(total_scans - done) : CHUNK_SCANS;
+        struct timespec start, end;
+
+        for (uint32_t s = 0; s < n; s++)
+        {
+            model_scan(p, chunk[s], CAPSENSE_NUM_BUTTONS, 0);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (uint32_t s = 0; s < n; s++)
+        {
+            run_scan(chunk[s]);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        elapsed_ns += (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+        done += n;
+    }
+
+    *false_per_hour = (m_press_count - start_presses) / p->hours;
+    *ns_per_scan = (total_scans > 0) ? elapsed_ns / total_scans : 0;
+    *measurements_per_scan = (total_scans > 0) ?
+        (double)(capsense_host_measurements() - start_measurements) / total_scans : 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+    static nrf_capsense_cfg_t cfg = {
+        {0},
+        capsense_event_handler,
+        0,
+        0,
+        0,
+        CAPSENSE_DEFAULT_RESOURCES
+    };
+    bench_params_t params = {
+        .noise_sigma = 1.0,
+        .spike_rate  = 0.001,
+        .touch_min   = 6,
+        .touch_max   = 16,
+        .touches     = 2000,
+        .hours       = 1.0,
+        .seed        = 1
+    };
+    uint32_t *latencies;
+    uint32_t count;
+    uint32_t misses;
+    double false_per_hour;
+    double ns_per_scan;
+    double measurements_per_scan;
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "-s") == 0)      params.noise_sigma = atof(argv[i + 1]);
+        else if (strcmp(argv[i], "-r") == 0) params.spike_rate = atof(argv[i + 1]);
+        else if (strcmp(argv[i], "-n") == 0) params.touches = strtoul(argv[i + 1], NULL, 10);
+        else if (strcmp(argv[i], "-h") == 0) params.hours = atof(argv[i + 1]);
+        else if (strcmp(argv[i], "-S") == 0) params.seed = strtoull(argv[i + 1], NULL, 10);
+        else
+        {
+            fprintf(stderr, "usage: %s [-s noise_sigma] [-r spike_rate] [-n touches] [-h hours] [-S seed]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    latencies = malloc(sizeof(uint32_t) * (params.touches + 1));
+    if (latencies == NULL)
+    {
+        return 2;
+    }
+
+    m_rng_state = params.seed * 0x9E3779B97F4A7C15ULL + 1;
+    for (unsigned int i = 0; i < CAPSENSE_NUM_BUTTONS; i++)
+    {
+        cfg.analog_pins[i] = i;
+    }
+    if (capsense_host_init(&cfg) != NRF_SUCCESS)
+    {
+        fprintf(stderr, "capsense init failed\n");
+        return 2;
+    }
+    calibrate(&params);
+
+    bench_latency(&params, latencies, &count, &misses);
+    qsort(latencies, count, sizeof(uint32_t), compare_u32);
+    bench_noise(&params, &false_per_hour, &ns_per_scan, &measurements_per_scan);
+
+    printf("buttons=%u debounce=%u margin=%u | latency p50/p90/p99 = %u/%u/%u scans (%u/%u/%u ms), missed %u/%u"
+           " | false presses/h = %.1f | %.0f ns/scan, %.2f measurements/scan\n",
+           CAPSENSE_NUM_BUTTONS, CAPSENSE_DEBOUNCE_CONFIDENCE_THRESHOLD, CAPSENSE_CALIBRATION_FILTER_MARGIN,
+           percentile(latencies, count, 50), percentile(latencies, count, 90), percentile(latencies, count, 99),
+           percentile(latencies, count, 50) * SCAN_INTERVAL_MS,
+           percentile(latencies, count, 90) * SCAN_INTERVAL_MS,
+           percentile(latencies, count, 99) * SCAN_INTERVAL_MS,
+           misses, params.touches,
+           false_per_hour, ns_per_scan, measurements_per_scan);
+
+    free(latencies);
+    return 0;
+}
@@ -0,0 +1,362 @@
+/* Copyright (c) 2016 Nordic Semiconductor. All Rights Reserved.
+ *
+ * The information contained herein is property of Nordic Semiconductor ASA.
+ * Terms and conditions of usage are described in detail in NORDIC
+ * SEMICONDUCTOR STANDARD SOFTWARE LICENSE AGREEMENT.
+ *
+ * Licensees are granted free, non-transferable use of the information. NO
+ * WARRANTY of ANY KIND is provided. This heading must NOT be removed from
+ * the file.
+ *
+ */
+
+// Benchmark of classifiers on the capsense feature vector.
+//
+// The library is run with each of the example classifiers below as
+// nrf_capsense_cfg_t.classifier, on a synthetic input that alternates
+// between finger touches (one channel) and palms (every channel at
+// once). For each classifier the tool reports:
+//
+// - Fingers: finger touches reported pressed, out of all touches.
+// - Palms: palm contacts that caused any press, out of all palms.
+// - Scan cost: host time per scan in the library, and the increase
+//   over running without a classifier (feature extraction included).
+// - Inference cost: host time per classifier call alone, timed over
+//   recorded feature vectors.
+//
+// Host times are only meaningful relative to each other; on target,
+// measure cycles with the DWT cycle counter around the hook.
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "capsense_host.h"
+#include "nrf_error.h"
+#include "nrf_capsense.h"
+#include "nrf_capsense_cfg.h"
+
+
+#define BASELINE_COUNTS         100
+#define NOISE_SIGMA             1.0
+#define FINGER_COUNTS           12
+#define PALM_COUNTS             25
+#define CONTACT_SCANS           20
+#define IDLE_SCANS              20
+#define CONTACTS                1000
+#define RECORDED_SCANS          4096
+#define INFERENCE_REPEAT        256
+
+#define ACTIVE_Q12              (4096 * 4 / BASELINE_COUNTS)    // 4 counts above baseline
+
+
+typedef struct
+{
+    const char *name;
+    capsense_classifier_t classifier;
+} classifier_entry_t;
+
+
+static uint64_t m_rng_state = 1;
+static uint32_t m_contact_mask;                 // Union of pin_mask during a contact
+static nrf_capsense_features_t m_recorded[RECORDED_SCANS];
+static uint32_t m_recorded_scan_mask[RECORDED_SCANS];
+static uint32_t m_recorded_pressed_mask[RECORDED_SCANS];
+static uint32_t m_recorded_count;
+
+
+static double rng_gaussian(void)
+{
+    double u1, u2;
+
+    // xorshift64*
+    m_rng_state ^= m_rng_state >> 12;
+    m_rng_state ^= m_rng_state << 25;
+    m_rng_state ^= m_rng_state >> 27;
+    u1 = (((m_rng_state * 2685821657736338717ULL) >> 32) + 0.5) / 4294967296.0;
+    m_rng_state ^= m_rng_state >> 12;
+    m_rng_state ^= m_rng_state << 25;
+    m_rng_state ^= m_rng_state >> 27;
+    u2 = (((m_rng_state * 2685821657736338717ULL) >> 32) + 0.5) / 4294967296.0;
+
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+
+// Reference: the library threshold decision, unchanged
+static uint32_t classify_threshold(const nrf_capsense_features_t *features,
+                                   uint32_t scan_mask,
+                                   uint32_t pressed_mask)
+{
+    return pressed_mask;
+}
+
+
+// Decision tree: a contact spread over most channels is a palm
+static uint32_t classify_tree(const nrf_capsense_features_t *features,
+                              uint32_t scan_mask,
+                              uint32_t pressed_mask)
+{
+    uint32_t active = 0;
+    uint32_t result = 0;
+
+    for (unsigned int i = 0; i < CAPSENSE_NUM_BUTTONS; i++)
+    {
+        if (features->channel[i].delta_q12 > ACTIVE_Q12)
+        {
+            active++;
+        }
+    }
+    if ((CAPSENSE_NUM_BUTTONS > 1) && (active * 2 > CAPSENSE_NUM_BUTTONS))
+    {
+        return 0;
+    }
+
+    // A jump of many times the press level within one scan is an
+    // impulse, not a finger.
+    for (unsigned int i = 0; i < CAPSENSE_NUM_BUTTONS; i++)
+    {
+        if ((pressed_mask & (1 << i)) && (features->channel[i].velocity_q12 < 8 * ACTIVE_Q12))
+        {
+            result |= 1 << i;
+        }
+    }
+    return result;
+}
+
+
+static int8_t quantize_s8(int32_t value, unsigned int shift)
+{
+    value >>= shift;
+    return (value > INT8_MAX) ? INT8_MAX : ((value < INT8_MIN) ? INT8_MIN : (int8_t)value);
+}
+
+
+// int8 dense layer: per channel, inputs are the three features of the
+// channel and the mean delta of the other channels, quantized to int8.
+static uint32_t classify_dense(const nrf_capsense_features_t *features,
+                               uint32_t scan_mask,
+                               uint32_t pressed_mask)
+{
+    static const int8_t weights[4] = {64, 8, 16, -96};
+    static const int32_t bias = -64 * 8;
+    int32_t sum_delta = 0;
+    uint32_t result = 0;
+
+    for (unsigned int i = 0; i < CAPSENSE_NUM_BUTTONS; i++)
+    {
+        sum_delta += features->channel[i].delta_q12;
+    }
+
+    for (unsigned int i = 0; i < CAPSENSE_NUM_BUTTONS; i++)
+    {
+        int32_t others = (CAPSENSE_NUM_BUTTONS > 1) ?
+            (sum_delta - features->channel[i].delta_q12) / (CAPSENSE_NUM_BUTTONS - 1) : 0;
+        int8_t x[4];
+        int32_t acc = bias;
+
+        x[0] = quantize_s8(features->channel[i].delta_q12, 5);
+        x[1] = quantize_s8(features->channel[i].velocity_q12, 5);
+        x[2] = quantize_s8(features->channel[i].energy_q12, 6);
+        x[3] = quantize_s8(others, 5);
+
+        for (unsigned int j = 0; j < 4; j++)
+        {
+            acc += weights[j] * x[j];
+        }
+        if (acc > 0)
+        {
+            result |= 1 << i;
+        }
+    }
+    return result;
+}
+
+
+static capsense_classifier_t m_classifier;
+
+
+// Wrapper installed in the configuration, recording the classifier
+// inputs for the inference timing.
+static uint32_t classify_recording(const nrf_capsense_features_t *features,
+                                   uint32_t scan_mask,
+                                   uint32_t pressed_mask)
+{
+    if (m_recorded_count < RECORDED_SCANS)
+    {
+        m_recorded[m_recorded_count] = *features;
+        m_recorded_scan_mask[m_recorded_count] = scan_mask;
+        m_recorded_pressed_mask[m_recorded_count] = pressed_mask;
+        m_recorded_count++;
+    }
+    return m_classifier(features, scan_mask, pressed_mask);
+}
+
+
+static void capsense_event_handler(enum capsense_event_t event, uint32_t pin_mask)
+{
+    if (event == CAPSENSE_BUTTON_EVENT)
+    {
+        m_contact_mask |= pin_mask;
+    }
+}
+
+
+static void model_scan(uint32_t *counts, uint32_t touch_mask, uint32_t touch_counts)
+{
+    for (unsigned int i = 0; i < CAPSENSE_NUM_BUTTONS; i++)
+    {
+        double value = BASELINE_COUNTS + NOISE_SIGMA * rng_gaussian();
+
+        if (touch_mask & (1 << i))
+        {
+            value += touch_counts;
+        }
+        counts[i] = (uint32_t)lround(value);
+    }
+}
+
+
+static double elapsed_ns(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+
+// Run the contact sequence. Return host time per scan in the library.
+static double run_contacts(uint32_t *fingers, uint32_t *palms)
+{
+    static uint32_t counts[CONTACT_SCANS + IDLE_SCANS][CAPSENSE_NUM_BUTTONS];
+    double library_ns = 0;
+
+    *fingers = 0;
+    *palms = 0;
+    m_rng_state = 1;
+
+    for (uint32_t c = 0; c < CONTACTS; c++)
+    {
+        bool palm = (c & 1) != 0;
+        uint32_t touch_mask = palm ? (1UL << CAPSENSE_NUM_BUTTONS) - 1 : 1UL << (c / 2 % CAPSENSE_NUM_BUTTONS);
+
+        struct timespec start, end;
+
+        for (uint32_t s = 0; s < CONTACT_SCANS + IDLE_SCANS; s++)
+        {
+            model_scan(counts[s], (s < CONTACT_SCANS) ? touch_mask : 0,
+                       palm ? PALM_COUNTS : FINGER_COUNTS);
+        }
+
+        m_contact_mask = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (uint32_t s = 0; s < CONTACT_SCANS + IDLE_SCANS; s++)
+        {
+            nrf_capsense_sample();
+            capsense_host_feed(counts[s]);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        library_ns += elapsed_ns(&start, &end);
+
+        if (palm && m_contact_mask)
+        {
+            (*palms)++;
+        }
+        if (!palm && (m_contact_mask & touch_mask))
+        {
+            (*fingers)++;
+        }
+    }
+
+    return library_ns / ((double)CONTACTS * (CONTACT_SCANS + IDLE_SCANS));
+}
+
+
+// Return host time per call of the classifier over the recorded inputs
+static double time_inference(capsense_classifier_t classifier)
+{
+    struct timespec start, end;
+    volatile uint32_t sink = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t r = 0; r < INFERENCE_REPEAT; r++)
+    {
+        for (uint32_t s = 0; s < m_recorded_count; s++)
+        {
+            sink += classifier(&m_recorded[s], m_recorded_scan_mask[s], m_recorded_pressed_mask[s]);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    (void)sink;
+
+    return (m_recorded_count > 0) ? elapsed_ns(&start, &end) / ((double)INFERENCE_REPEAT * m_recorded_count) : 0;
+}
+
+
+static void calibrate(void)
+{
+    uint32_t counts[CAPSENSE_NUM_BUTTONS];
+
+    nrf_capsense_calibrate();
+    while (capsense_host_pending())
+    {
+        model_scan(counts, 0, 0);
+        capsense_host_feed(counts);
+    }
+}
+
+
+int main(void)
+{
+    static nrf_capsense_cfg_t cfg = {
+        {0},
+        capsense_event_handler,
+        0,
+        0,
+        0,
+        CAPSENSE_DEFAULT_RESOURCES
+    };
+    static const classifier_entry_t classifiers[] = {
+        {"none", 0},
+        {"threshold", classify_threshold},
+        {"tree", classify_tree},
+        {"dense", classify_dense},
+    };
+    double none_ns = 0;
+
+    for (unsigned int i = 0; i < CAPSENSE_NUM_BUTTONS; i++)
+    {
+        cfg.analog_pins[i] = i;
+    }
+
+    for (unsigned int k = 0; k < sizeof(classifiers) / sizeof(classifiers[0]); k++)
+    {
+        uint32_t fingers;
+        uint32_t palms;
+        double scan_ns;
+
+        m_classifier = classifiers[k].classifier;
+        m_recorded_count = 0;
+        cfg.classifier = m_classifier ? classify_recording : 0;
+        if (capsense_host_init(&cfg) != NRF_SUCCESS)
+        {
+            fprintf(stderr, "capsense init failed\n");
+            return 2;
+        }
+        calibrate();
+
+        scan_ns = run_contacts(&fingers, &palms);
+        if (m_classifier == 0)
+        {
+            none_ns = scan_ns;
+        }
+
+        printf("buttons=%u classifier=%-9s | fingers %u/%u, palms %u/%u | %.0f ns/scan (%+.0f) | %.1f ns/inference\n",
+               CAPSENSE_NUM_BUTTONS, classifiers[k].name,
+               fingers, CONTACTS / 2, palms, CONTACTS / 2,
+               scan_ns, scan_ns - none_ns,
+               m_classifier ? time_inference(m_classifier) : 0.0);
+    }
+
+    return 0;
+}
@@ -0,0 +1,149 @@
+/* Copyright (c) 2016 Nordic Semiconductor. All Rights Reserved.
+ *
+ * The information contained herein is property of Nordic Semiconductor ASA.
+ * Terms and conditions of usage are described in detail in NORDIC
+ * SEMICONDUCTOR STANDARD SOFTWARE LICENSE AGREEMENT.
+ *
+ * Licensees are granted free, non-transferable use of the information. NO
+ * WARRANTY of ANY KIND is provided. This heading must NOT be removed from
+ * the file.
+ *
+ */
+
+#include "nrf.h"
+#include "capsense_host.h"
+#include "nrf_capsense_cfg.h"
+
+
+// COMP interrupt handler implemented by the library
+void COMP_LPCOMP_IRQHandler(void);
+
+
+static nrf_capsense_cfg_t *m_cfg;
+static uint64_t m_measurements;
+static int32_t m_temperature;
+
+
+static unsigned int channel_of(uint32_t psel)
+{
+    for (unsigned int i = 0; i < CAPSENSE_NUM_BUTTONS; i++)
+    {
+        if (m_cfg->analog_pins[i] == psel)
+        {
+            return i;
+        }
+    }
+
+    return 0;
+}
+
+
+uint32_t capsense_host_init(nrf_capsense_cfg_t *cfg)
+{
+    m_cfg = cfg;
+    m_measurements = 0;
+    return nrf_capsense_init(cfg);
+}
+
+
+void capsense_host_temperature_set(int32_t temp)
+{
+    m_temperature = temp;
+}
+
+
+// Complete the TEMP and SAADC tasks triggered since the previous call
+static void environment_complete(void)
+{
+    if (NRF_TEMP->TASKS_START)
+    {
+        NRF_TEMP->TASKS_START = 0;
+        NRF_TEMP->TEMP = m_temperature;
+        NRF_TEMP->EVENTS_DATARDY = 1;
+    }
+    if (NRF_SAADC->TASKS_START)
+    {
+        NRF_SAADC->TASKS_START = 0;
+        NRF_SAADC->EVENTS_STARTED = 1;
+    }
+    if (NRF_SAADC->TASKS_SAMPLE)
+    {
+        NRF_SAADC->TASKS_SAMPLE = 0;
+        NRF_SAADC->EVENTS_END = 1;
+    }
+    if (NRF_SAADC->TASKS_STOP)
+    {
+        NRF_SAADC->TASKS_STOP = 0;
+        NRF_SAADC->EVENTS_STOPPED = 1;
+    }
+}
+
+
+// Return count as measured with the current comparator setting. The
+// half period is inversely proportional to the current source and
+// proportional to the threshold window; the default setting (10 mA,
+// THDOWN 5, THUP 60) gives count unchanged.
+static uint32_t comp_scaled(uint32_t count)
+{
+    uint32_t current = NRF_COMP->ISOURCE >> COMP_ISOURCE_ISOURCE_Pos;      // Units of 2.5 mA...
+    uint32_t th_down = (NRF_COMP->TH >> COMP_TH_THDOWN_Pos) & 0x3F;
+    uint32_t th_up = (NRF_COMP->TH >> COMP_TH_THUP_Pos) & 0x3F;
+
+    if ((current == COMP_ISOURCE_ISOURCE_Off) || (th_up <= th_down))
+    {
+        return count;
+    }
+    current = 1 << (current - COMP_ISOURCE_ISOURCE_Ien2mA5);                // ...as 1, 2 or 4
+
+    return (uint32_t)(((uint64_t)count * 4 * (th_up - th_down)) / (current * 55));
+}
+
+
+uint64_t capsense_host_measurements(void)
+{
+    return m_measurements;
+}
+
+
+int capsense_host_pending(void)
+{
+    return NRF_COMP->TASKS_START != 0;
+}
+
+
+void capsense_host_feed(const uint32_t *counts)
+{
+    // One pass of the library's channel sequence. A new run of a
+    // multi-run operation (calibration) is started from within the
+    // last interrupt of the previous run, so stop once a channel is
+    // about to be sampled a second time in order to let the caller
+    // supply the next row of counts.
+    uint32_t fed_mask = 0;
+
+    environment_complete();
+
+    while (NRF_COMP->TASKS_START)
+    {
+        unsigned int channel = channel_of(NRF_COMP->PSEL);
+
+        if (fed_mask & (1 << channel))
+        {
+            break;
+        }
+        fed_mask |= 1 << channel;
+
+        NRF_COMP->TASKS_START = 0;
+        m_measurements++;
+        if (counts[channel] == 0)
+        {
+            m_cfg->resources.timer->EVENTS_COMPARE[1] = 1;
+            nrf_capsense_timer_irq_handler();
+        }
+        else
+        {
+            m_cfg->resources.timer->CC[0] = comp_scaled(counts[channel]);
+            NRF_COMP->EVENTS_DOWN = 1;
+            COMP_LPCOMP_IRQHandler();
+        }
+    }
+}
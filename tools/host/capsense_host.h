@@ -0,0 +1,54 @@
+/* Copyright (c) 2016 Nordic Semiconductor. All Rights Reserved.
+ *
+ * The information contained herein is property of Nordic Semiconductor ASA.
+ * Terms and conditions of usage are described in detail in NORDIC
+ * SEMICONDUCTOR STANDARD SOFTWARE LICENSE AGREEMENT.
+ *
+ * Licensees are granted free, non-transferable use of the information. NO
+ * WARRANTY of ANY KIND is provided. This heading must NOT be removed from
+ * the file.
+ *
+ */
+
+#ifndef CAPSENSE_HOST_H__
+#define CAPSENSE_HOST_H__
+
+#include <stdint.h>
+#include "nrf_capsense.h"
+
+
+// Initialize the capsense library on the host register model. The
+// configuration must stay valid for as long as the library is used,
+// exactly as on target. Returns the result of nrf_capsense_init().
+uint32_t capsense_host_init(nrf_capsense_cfg_t *cfg);
+
+
+// Complete every measurement the library starts until it stops
+// starting new ones. counts holds the half period (in 16 MHz timer
+// ticks) to report for each channel, indexed as cfg->analog_pins. A
+// count of 0 makes that measurement time out instead.
+//
+// Call after nrf_capsense_sample() or nrf_capsense_calibrate() (or
+// after a previous call, to feed the next calibration run).
+//
+// TEMP and SAADC conversions started by the library complete at the
+// start of the call. The counts are scaled by the comparator setting
+// (current source and threshold window) relative to the default one,
+// so that the comparator auto-select sweep sees a difference.
+void capsense_host_feed(const uint32_t *counts);
+
+
+// Set the die temperature, in 0.25 degC, returned by TEMP conversions.
+void capsense_host_temperature_set(int32_t temp);
+
+
+// Return true if the library has started a measurement which has not
+// yet been fed.
+int capsense_host_pending(void);
+
+
+// Return the number of measurements fed (including timeouts) since
+// capsense_host_init().
+uint64_t capsense_host_measurements(void);
+
+#endif // CAPSENSE_HOST_H__
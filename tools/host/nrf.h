@@ -0,0 +1,291 @@
+/* Copyright (c) 2016 Nordic Semiconductor. All Rights Reserved.
+ *
+ * The information contained herein is property of Nordic Semiconductor ASA.
+ * Terms and conditions of usage are described in detail in NORDIC
+ * SEMICONDUCTOR STANDARD SOFTWARE LICENSE AGREEMENT.
+ *
+ * Licensees are granted free, non-transferable use of the information. NO
+ * WARRANTY of ANY KIND is provided. This heading must NOT be removed from
+ * the file.
+ *
+ */
+
+// Host replacement for the nRF52 device header. Peripherals are plain
+// structs in RAM, so that nrf_capsense.c can be compiled unmodified
+// for the host. Writing a task register only stores the value; the
+// host tool is responsible for acting on it (e.g. feeding a sample
+// when NRF_COMP->TASKS_START is set). Only the registers and fields
+// used by the capsense library are modelled.
+
+#ifndef NRF_HOST_H__
+#define NRF_HOST_H__
+
+#include <stdint.h>
+
+typedef struct
+{
+    volatile uint32_t TASKS_START;
+    volatile uint32_t TASKS_STOP;
+    volatile uint32_t TASKS_SAMPLE;
+    volatile uint32_t EVENTS_READY;
+    volatile uint32_t EVENTS_DOWN;
+    volatile uint32_t EVENTS_UP;
+    volatile uint32_t EVENTS_CROSS;
+    volatile uint32_t SHORTS;
+    volatile uint32_t INTENSET;
+    volatile uint32_t INTENCLR;
+    volatile uint32_t PSEL;
+    volatile uint32_t REFSEL;
+    volatile uint32_t EXTREFSEL;
+    volatile uint32_t TH;
+    volatile uint32_t MODE;
+    volatile uint32_t HYST;
+    volatile uint32_t ISOURCE;
+    volatile uint32_t ENABLE;
+    volatile uint32_t RESULT;
+} NRF_COMP_Type;
+
+typedef struct
+{
+    volatile uint32_t TASKS_START;
+    volatile uint32_t TASKS_STOP;
+    volatile uint32_t TASKS_COUNT;
+    volatile uint32_t TASKS_CLEAR;
+    volatile uint32_t TASKS_CAPTURE[6];
+    volatile uint32_t EVENTS_COMPARE[6];
+    volatile uint32_t SHORTS;
+    volatile uint32_t INTENSET;
+    volatile uint32_t INTENCLR;
+    volatile uint32_t MODE;
+    volatile uint32_t BITMODE;
+    volatile uint32_t PRESCALER;
+    volatile uint32_t CC[6];
+} NRF_TIMER_Type;
+
+typedef struct
+{
+    volatile uint32_t EEP;
+    volatile uint32_t TEP;
+} PPI_CH_Type;
+
+typedef struct
+{
+    volatile uint32_t TEP;
+} PPI_FORK_Type;
+
+typedef struct
+{
+    volatile uint32_t CHEN;
+    volatile uint32_t CHENSET;
+    volatile uint32_t CHENCLR;
+    PPI_CH_Type CH[20];
+    PPI_FORK_Type FORK[32];
+} NRF_PPI_Type;
+
+typedef struct
+{
+    volatile uint32_t TASKS_OUT[8];
+    volatile uint32_t TASKS_SET[8];
+    volatile uint32_t TASKS_CLR[8];
+    volatile uint32_t EVENTS_IN[8];
+    volatile uint32_t EVENTS_PORT;
+    volatile uint32_t INTENSET;
+    volatile uint32_t INTENCLR;
+    volatile uint32_t CONFIG[8];
+} NRF_GPIOTE_Type;
+
+// TEMP and SAADC conversions are completed by capsense_host_feed().
+// The SAADC result is never written, as RESULT.PTR cannot hold a host
+// address, so the supply reads as 0.
+typedef struct
+{
+    volatile uint32_t TASKS_START;
+    volatile uint32_t TASKS_STOP;
+    volatile uint32_t EVENTS_DATARDY;
+    volatile int32_t  TEMP;
+} NRF_TEMP_Type;
+
+typedef struct
+{
+    volatile uint32_t PSELP;
+    volatile uint32_t PSELN;
+    volatile uint32_t CONFIG;
+    volatile uint32_t LIMIT;
+} SAADC_CH_Type;
+
+typedef struct
+{
+    volatile uint32_t PTR;
+    volatile uint32_t MAXCNT;
+    volatile uint32_t AMOUNT;
+} SAADC_RESULT_Type;
+
+typedef struct
+{
+    volatile uint32_t TASKS_START;
+    volatile uint32_t TASKS_SAMPLE;
+    volatile uint32_t TASKS_STOP;
+    volatile uint32_t EVENTS_STARTED;
+    volatile uint32_t EVENTS_END;
+    volatile uint32_t EVENTS_STOPPED;
+    volatile uint32_t ENABLE;
+    SAADC_CH_Type CH[8];
+    volatile uint32_t RESOLUTION;
+    SAADC_RESULT_Type RESULT;
+} NRF_SAADC_Type;
+
+// RTC is declared so that the library compiles with
+// CAPSENSE_FIXED_SLOT_ENABLED. The counter does not advance.
+typedef struct
+{
+    volatile uint32_t TASKS_START;
+    volatile uint32_t TASKS_STOP;
+    volatile uint32_t TASKS_CLEAR;
+    volatile uint32_t EVENTS_COMPARE[4];
+    volatile uint32_t EVTENSET;
+    volatile uint32_t EVTENCLR;
+    volatile uint32_t COUNTER;
+    volatile uint32_t PRESCALER;
+    volatile uint32_t CC[4];
+} NRF_RTC_Type;
+
+typedef struct
+{
+    volatile uint32_t TASKS_CONSTLAT;
+    volatile uint32_t TASKS_LOWPWR;
+} NRF_POWER_Type;
+
+extern NRF_COMP_Type   nrf_host_comp;
+extern NRF_TIMER_Type  nrf_host_timer[5];
+extern NRF_PPI_Type    nrf_host_ppi;
+extern NRF_GPIOTE_Type nrf_host_gpiote;
+extern NRF_POWER_Type  nrf_host_power;
+extern NRF_TEMP_Type   nrf_host_temp;
+extern NRF_SAADC_Type  nrf_host_saadc;
+extern NRF_RTC_Type    nrf_host_rtc[3];
+
+#define NRF_COMP                    (&nrf_host_comp)
+#define NRF_TIMER0                  (&nrf_host_timer[0])
+#define NRF_TIMER1                  (&nrf_host_timer[1])
+#define NRF_TIMER2                  (&nrf_host_timer[2])
+#define NRF_TIMER3                  (&nrf_host_timer[3])
+#define NRF_TIMER4                  (&nrf_host_timer[4])
+#define NRF_PPI                     (&nrf_host_ppi)
+#define NRF_GPIOTE                  (&nrf_host_gpiote)
+#define NRF_POWER                   (&nrf_host_power)
+#define NRF_TEMP                    (&nrf_host_temp)
+#define NRF_SAADC                   (&nrf_host_saadc)
+#define NRF_RTC0                    (&nrf_host_rtc[0])
+#define NRF_RTC1                    (&nrf_host_rtc[1])
+#define NRF_RTC2                    (&nrf_host_rtc[2])
+
+typedef enum
+{
+    TIMER0_IRQn      = 8,
+    TIMER1_IRQn      = 9,
+    TIMER2_IRQn      = 10,
+    COMP_LPCOMP_IRQn = 19,
+    TIMER3_IRQn      = 26,
+    TIMER4_IRQn      = 27
+} IRQn_Type;
+
+#define LPCOMP_IRQn                 COMP_LPCOMP_IRQn
+#define __NVIC_PRIO_BITS            3
+
+static inline void NVIC_SetPriority(IRQn_Type irqn, uint32_t priority)
+{
+    (void)irqn;
+    (void)priority;
+}
+
+// Enabled interrupts, bit n for IRQn n
+extern uint32_t nrf_host_nvic_enabled;
+
+static inline void NVIC_EnableIRQ(IRQn_Type irqn)
+{
+    nrf_host_nvic_enabled |= 1UL << irqn;
+}
+
+static inline void NVIC_DisableIRQ(IRQn_Type irqn)
+{
+    nrf_host_nvic_enabled &= ~(1UL << irqn);
+}
+
+// Interrupt masking has no effect on the host, as the library
+// interrupt handlers are only called from the host tools.
+static inline uint32_t __get_PRIMASK(void)
+{
+    return 0;
+}
+
+static inline void __set_PRIMASK(uint32_t primask)
+{
+    (void)primask;
+}
+
+static inline void __disable_irq(void)
+{
+}
+
+// COMP
+#define COMP_ENABLE_ENABLE_Pos                 0
+#define COMP_ENABLE_ENABLE_Disabled            0
+#define COMP_ENABLE_ENABLE_Enabled             2
+#define COMP_REFSEL_REFSEL_Pos                 0
+#define COMP_REFSEL_REFSEL_VDD                 4
+#define COMP_TH_THDOWN_Pos                     0
+#define COMP_TH_THUP_Pos                       8
+#define COMP_MODE_SP_Pos                       0
+#define COMP_MODE_SP_Low                       0
+#define COMP_MODE_SP_Normal                    1
+#define COMP_MODE_SP_High                      2
+#define COMP_MODE_MAIN_Pos                     8
+#define COMP_MODE_MAIN_SE                      0
+#define COMP_ISOURCE_ISOURCE_Pos               0
+#define COMP_ISOURCE_ISOURCE_Off               0
+#define COMP_ISOURCE_ISOURCE_Ien2mA5           1
+#define COMP_ISOURCE_ISOURCE_Ien5mA            2
+#define COMP_ISOURCE_ISOURCE_Ien10mA           3
+#define COMP_INTEN_DOWN_Msk                    (1UL << 1)
+#define COMP_INTENCLR_DOWN_Msk                 (1UL << 1)
+#define COMP_SHORTS_DOWN_STOP_Msk              (1UL << 2)
+
+// TIMER
+#define TIMER_BITMODE_BITMODE_Pos              0
+#define TIMER_BITMODE_BITMODE_16Bit            0
+#define TIMER_SHORTS_COMPARE1_CLEAR_Msk        (1UL << 1)
+#define TIMER_SHORTS_COMPARE1_STOP_Msk         (1UL << 9)
+#define TIMER_INTENSET_COMPARE1_Msk            (1UL << 17)
+#define TIMER_INTENCLR_COMPARE1_Msk            (1UL << 17)
+
+// RTC
+#define RTC_EVTEN_COMPARE0_Msk                 (1UL << 16)
+
+// GPIOTE
+#define GPIOTE_CONFIG_MODE_Pos                 0
+#define GPIOTE_CONFIG_MODE_Task                3
+#define GPIOTE_CONFIG_PSEL_Pos                 8
+#define GPIOTE_CONFIG_POLARITY_Pos             16
+#define GPIOTE_CONFIG_POLARITY_Toggle          3
+#define GPIOTE_CONFIG_OUTINIT_Pos              20
+#define GPIOTE_CONFIG_OUTINIT_Low              0
+
+// SAADC
+#define SAADC_ENABLE_ENABLE_Pos                0
+#define SAADC_ENABLE_ENABLE_Disabled           0
+#define SAADC_ENABLE_ENABLE_Enabled            1
+#define SAADC_RESOLUTION_VAL_Pos               0
+#define SAADC_RESOLUTION_VAL_10bit             1
+#define SAADC_CH_PSELP_PSELP_Pos               0
+#define SAADC_CH_PSELP_PSELP_NC                0
+#define SAADC_CH_PSELP_PSELP_VDD               9
+#define SAADC_CH_PSELN_PSELN_Pos               0
+#define SAADC_CH_PSELN_PSELN_NC                0
+#define SAADC_CH_CONFIG_GAIN_Pos               8
+#define SAADC_CH_CONFIG_GAIN_Gain1_6           0
+#define SAADC_CH_CONFIG_REFSEL_Pos             12
+#define SAADC_CH_CONFIG_REFSEL_Internal        0
+#define SAADC_CH_CONFIG_TACQ_Pos               16
+#define SAADC_CH_CONFIG_TACQ_10us              2
+
+#endif // NRF_HOST_H__
@@ -0,0 +1,25 @@
+/* Copyright (c) 2016 Nordic Semiconductor. All Rights Reserved.
+ *
+ * The information contained herein is property of Nordic Semiconductor ASA.
+ * Terms and conditions of usage are described in detail in NORDIC
+ * SEMICONDUCTOR STANDARD SOFTWARE LICENSE AGREEMENT.
+ *
+ * Licensees are granted free, non-transferable use of the information. NO
+ * WARRANTY of ANY KIND is provided. This heading must NOT be removed from
+ * the file.
+ *
+ */
+
+#include "nrf.h"
+
+
+// Peripheral register blocks used in place of the hardware.
+NRF_COMP_Type   nrf_host_comp;
+NRF_TIMER_Type  nrf_host_timer[5];
+NRF_PPI_Type    nrf_host_ppi;
+NRF_GPIOTE_Type nrf_host_gpiote;
+NRF_POWER_Type  nrf_host_power;
+NRF_TEMP_Type   nrf_host_temp;
+NRF_SAADC_Type  nrf_host_saadc;
+NRF_RTC_Type    nrf_host_rtc[3];
+uint32_t        nrf_host_nvic_enabled;
@@ -0,0 +1,213 @@
+/* Copyright (c) 2016 Nordic Semiconductor. All Rights Reserved.
+ *
+ * The information contained herein is property of Nordic Semiconductor ASA.
+ * Terms and conditions of usage are described in detail in NORDIC
+ * SEMICONDUCTOR STANDARD SOFTWARE LICENSE AGREEMENT.
+ *
+ * Licensees are granted free, non-transferable use of the information. NO
+ * WARRANTY of ANY KIND is provided. This heading must NOT be removed from
+ * the file.
+ *
+ */
+
+// Test of the resource registry and of the resource handling of
+// nrf_capsense_init(): conflicts with other drivers, rollback of a
+// failed (re)initialization, re-initialization onto other resources
+// and TIMER interrupt dispatch. Built with TIMER1 and TIMER2 dispatched
+// by the registry (see Makefile), so that the TIMERn_IRQHandler
+// functions are the entry points, as on target, and with the guard
+// enabled, so that the fork of the clear channel is wired.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "nrf.h"
+#include "nrf_error.h"
+#include "nrf_capsense.h"
+#include "nrf_resource.h"
+
+
+#define CHECK(condition)    check((condition), #condition, __LINE__)
+
+
+void TIMER1_IRQHandler(void);
+void TIMER2_IRQHandler(void);
+
+
+static const char m_other[] = "other";
+static unsigned int m_failures;
+static unsigned int m_timeouts;
+
+
+static void check(bool ok, const char *condition, int line)
+{
+    if (!ok)
+    {
+        printf("FAIL %s:%d: %s\n", __FILE__, line, condition);
+        m_failures++;
+    }
+}
+
+
+static void capsense_event_handler(enum capsense_event_t event, uint32_t pin_mask)
+{
+    if (event == CAPSENSE_TIMEOUT_EVENT)
+    {
+        m_timeouts++;
+    }
+}
+
+
+// Start a scan and time out its first measurement through irq_handler.
+// Return true if the library saw the timeout.
+static bool timeout_through(NRF_TIMER_Type *timer, void (*irq_handler)(void))
+{
+    unsigned int timeouts = m_timeouts;
+
+    nrf_capsense_sample();
+    timer->EVENTS_COMPARE[1] = 1;
+    irq_handler();
+    timer->EVENTS_COMPARE[1] = 0;
+    NRF_COMP->TASKS_START = 0;
+
+    return m_timeouts == timeouts + 1;
+}
+
+
+static void test_registry(void)
+{
+    CHECK(nrf_resource_claim(NRF_RESOURCE_PPI_CHANNEL, 19, m_other) == NRF_SUCCESS);
+    CHECK(nrf_resource_claim(NRF_RESOURCE_PPI_CHANNEL, 19, m_other) == NRF_ERROR_BUSY);
+    CHECK(nrf_resource_claim(NRF_RESOURCE_PPI_CHANNEL, 20, m_other) == NRF_ERROR_INVALID_PARAM);
+    CHECK(nrf_resource_release(NRF_RESOURCE_PPI_CHANNEL, 19, "capsense") == NRF_ERROR_BUSY);
+    CHECK(nrf_resource_release(NRF_RESOURCE_PPI_CHANNEL, 19, m_other) == NRF_SUCCESS);
+    CHECK(nrf_resource_owner(NRF_RESOURCE_PPI_CHANNEL, 19) == 0);
+
+    CHECK(!nrf_resource_timer_dispatched(0));
+    CHECK(nrf_resource_timer_dispatched(1));
+    CHECK(nrf_resource_timer_dispatched(2));
+    CHECK(!nrf_resource_timer_dispatched(5));
+    CHECK(nrf_resource_claim(NRF_RESOURCE_TIMER, 0, m_other) == NRF_SUCCESS);
+    CHECK(nrf_resource_timer_handler_set(0, 0, m_other) == NRF_ERROR_INVALID_PARAM);
+    nrf_resource_release_all(m_other);
+    CHECK(nrf_resource_owner(NRF_RESOURCE_TIMER, 0) == 0);
+}
+
+
+int main(void)
+{
+    static nrf_capsense_cfg_t cfg_a = {
+        {0, 1},
+        capsense_event_handler,
+        0,
+        0,
+        0,
+        {NRF_TIMER1, 0, 1, 2, 3}
+    };
+    static nrf_capsense_cfg_t cfg_b = {
+        {0, 1},
+        capsense_event_handler,
+        0,
+        0,
+        0,
+        {NRF_TIMER2, 3, 4, 5, 3}
+    };
+    static nrf_capsense_cfg_t cfg_c = {
+        {0, 1},
+        capsense_event_handler,
+        0,
+        0,
+        0,
+        {NRF_TIMER1, 6, 7, 8, 3}
+    };
+    static nrf_capsense_cfg_t cfg_d = {
+        {0, 1},
+        capsense_event_handler,
+        0,
+        0,
+        0,
+        {NRF_TIMER3, 3, 4, 5, 3}
+    };
+
+    test_registry();
+
+    // Conflict: another driver holds a PPI channel of the configuration.
+    // Nothing is claimed.
+    CHECK(nrf_resource_claim(NRF_RESOURCE_PPI_CHANNEL, 1, m_other) == NRF_SUCCESS);
+    CHECK(nrf_capsense_init(&cfg_a) == NRF_ERROR_BUSY);
+    CHECK(nrf_resource_owner(NRF_RESOURCE_TIMER, 1) == 0);
+    CHECK(nrf_resource_owner(NRF_RESOURCE_COMP, 0) == 0);
+    CHECK(nrf_resource_owner(NRF_RESOURCE_PPI_CHANNEL, 0) == 0);
+    CHECK(nrf_resource_owner(NRF_RESOURCE_PPI_CHANNEL, 1) == m_other);
+    nrf_resource_release_all(m_other);
+
+    // Invalid configurations
+    cfg_a.resources.ppi_ch_capture = 0;
+    CHECK(nrf_capsense_init(&cfg_a) == NRF_ERROR_INVALID_PARAM);
+    cfg_a.resources.ppi_ch_capture = 1;
+    cfg_a.resources.irq_priority = 8;
+    CHECK(nrf_capsense_init(&cfg_a) == NRF_ERROR_INVALID_PARAM);
+    cfg_a.resources.irq_priority = 3;
+    CHECK(nrf_resource_owner(NRF_RESOURCE_COMP, 0) == 0);
+
+    // Initialization, and dispatch of the TIMER1 interrupt
+    CHECK(nrf_capsense_init(&cfg_a) == NRF_SUCCESS);
+    CHECK(nrf_resource_owner(NRF_RESOURCE_TIMER, 1) != 0);
+    CHECK(nrf_resource_owner(NRF_RESOURCE_PPI_CHANNEL, 0) != 0);
+    CHECK(nrf_resource_owner(NRF_RESOURCE_PPI_CHANNEL, 1) != 0);
+    CHECK(nrf_host_nvic_enabled & (1UL << TIMER1_IRQn));
+    CHECK(timeout_through(NRF_TIMER1, TIMER1_IRQHandler));
+
+    // Re-initialization onto TIMER2 and PPI channels 3 and 4. The old
+    // hardware is stopped, and the old resources unwired and released.
+    CHECK(nrf_capsense_init(&cfg_b) == NRF_SUCCESS);
+    CHECK(nrf_resource_owner(NRF_RESOURCE_TIMER, 1) == 0);
+    CHECK(nrf_resource_owner(NRF_RESOURCE_PPI_CHANNEL, 0) == 0);
+    CHECK(nrf_resource_owner(NRF_RESOURCE_PPI_CHANNEL, 1) == 0);
+    CHECK(nrf_resource_owner(NRF_RESOURCE_TIMER, 2) != 0);
+    CHECK(nrf_resource_owner(NRF_RESOURCE_PPI_CHANNEL, 3) != 0);
+    CHECK(nrf_resource_owner(NRF_RESOURCE_COMP, 0) != 0);
+    CHECK(NRF_PPI->CH[0].EEP == 0);
+    CHECK(NRF_PPI->CH[0].TEP == 0);
+    CHECK(NRF_PPI->CH[1].EEP == 0);
+    CHECK(NRF_PPI->CH[1].TEP == 0);
+    CHECK(NRF_PPI->FORK[0].TEP == 0);
+    CHECK(NRF_PPI->FORK[1].TEP == 0);
+    CHECK(NRF_PPI->FORK[3].TEP == (uint32_t)&NRF_GPIOTE->TASKS_CLR[CAPSENSE_GUARD_GPIOTE_CH]);
+    CHECK(NRF_TIMER1->INTENCLR == TIMER_INTENCLR_COMPARE1_Msk);
+    CHECK(!(nrf_host_nvic_enabled & (1UL << TIMER1_IRQn)));
+    CHECK(nrf_host_nvic_enabled & (1UL << TIMER2_IRQn));
+    CHECK(!timeout_through(NRF_TIMER1, TIMER1_IRQHandler));
+    CHECK(timeout_through(NRF_TIMER2, TIMER2_IRQHandler));
+
+    // Rollback: the new configuration conflicts with another driver.
+    // The claims of the attempt are given back, and the previous
+    // configuration is kept and set up again.
+    CHECK(nrf_resource_claim(NRF_RESOURCE_PPI_CHANNEL, 7, m_other) == NRF_SUCCESS);
+    NRF_PPI->CHENSET = 0;
+    CHECK(nrf_capsense_init(&cfg_c) == NRF_ERROR_BUSY);
+    CHECK(nrf_resource_owner(NRF_RESOURCE_TIMER, 1) == 0);
+    CHECK(nrf_resource_owner(NRF_RESOURCE_PPI_CHANNEL, 6) == 0);
+    CHECK(nrf_resource_owner(NRF_RESOURCE_PPI_CHANNEL, 7) == m_other);
+    CHECK(nrf_resource_owner(NRF_RESOURCE_TIMER, 2) != 0);
+    CHECK(nrf_resource_owner(NRF_RESOURCE_PPI_CHANNEL, 3) != 0);
+    CHECK(nrf_resource_owner(NRF_RESOURCE_PPI_CHANNEL, 4) != 0);
+    CHECK(NRF_PPI->CH[3].EEP == (uint32_t)&NRF_COMP->EVENTS_UP);
+    CHECK(NRF_PPI->CHENSET == (1UL << 4));
+    CHECK(nrf_host_nvic_enabled & (1UL << TIMER2_IRQn));
+    CHECK(timeout_through(NRF_TIMER2, TIMER2_IRQHandler));
+    nrf_resource_release_all(m_other);
+
+    // A TIMER without registry dispatch: the handler is not set, and
+    // the application calls nrf_capsense_timer_irq_handler() itself.
+    CHECK(nrf_capsense_init(&cfg_d) == NRF_SUCCESS);
+    CHECK(nrf_resource_owner(NRF_RESOURCE_TIMER, 2) == 0);
+    CHECK(nrf_resource_owner(NRF_RESOURCE_TIMER, 3) != 0);
+    CHECK(nrf_resource_owner(NRF_RESOURCE_PPI_CHANNEL, 3) != 0);
+    CHECK(timeout_through(NRF_TIMER3, nrf_capsense_timer_irq_handler));
+
+    if (m_failures == 0)
+    {
+        printf("PASS resource_test\n");
+    }
+    return (m_failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,300 @@
+/* Copyright (c) 2016 Nordic Semiconductor. All Rights Reserved.
+ *
+ * The information contained herein is property of Nordic Semiconductor ASA.
+ * Terms and conditions of usage are described in detail in NORDIC
+ * SEMICONDUCTOR STANDARD SOFTWARE LICENSE AGREEMENT.
+ *
+ * Licensees are granted free, non-transferable use of the information. NO
+ * WARRANTY of ANY KIND is provided. This heading must NOT be removed from
+ * the file.
+ *
+ */
+
+// Replay a recorded capsense trace through the capsense library and
+// print the resulting event stream.
+//
+// The trace is a CSV file with one line per scan and one column per
+// channel, holding the captured half period (TIMER CC[0]) of each
+// channel. Empty lines and lines starting with '#' are ignored. A
+// count of 0 replays a measurement timeout. Directive lines act before
+// the next scan:
+//
+//   @tuning <filter_margin> <debounce_threshold> <channel_mask>
+//       Call nrf_capsense_tuning_set().
+//   @calibrate
+//       Call nrf_capsense_calibrate(); the following lines calibrate.
+//   @proximity <pin_mask>
+//       Replay the following lines as proximity scans of pin_mask
+//       (nrf_capsense_proximity_sample()), each count being fed for
+//       every integrated half period. A mask of 0 goes back to button
+//       scans.
+//   @classifier <max_channels>
+//       Install a classifier that drops every press while more than
+//       max_channels channels are above 2 % of their baseline (palm
+//       rejection). 0 removes the classifier.
+//   @temperature <temp>
+//       Set the die temperature (0.25 degC) of the host TEMP model.
+//
+// The first lines are used for calibration (CAPSENSE_CALIBRATION_RUNS,
+// after the comparator sweep when enabled); every following line is
+// one call to nrf_capsense_sample().
+//
+// Each event is printed as "<time_ms> <event> <pin_mask>", where the
+// time is the scan index times the scan interval.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "capsense_host.h"
+#include "nrf_error.h"
+#include "nrf_capsense.h"
+#include "nrf_capsense_cfg.h"
+
+
+#define DEFAULT_INTERVAL_MS   10
+#define LINE_LENGTH           256
+#define CONTACT_Q12           (4096 / 50)   // 2 % above baseline
+
+
+static uint32_t m_time_ms;
+static nrf_capsense_cfg_t m_cfg;
+static uint32_t m_classifier_max_channels;
+
+
+static const char * event_name(enum capsense_event_t event)
+{
+    switch (event)
+    {
+    case CAPSENSE_BUTTON_EVENT:      return "BUTTON";
+    case CAPSENSE_CALIBRATION_EVENT: return "CALIBRATION";
+    case CAPSENSE_TIMEOUT_EVENT:     return "TIMEOUT";
+    case CAPSENSE_PROXIMITY_EVENT:   return "PROXIMITY";
+    case CAPSENSE_MOISTURE_EVENT:    return "MOISTURE";
+    case CAPSENSE_SELFTEST_EVENT:    return "SELFTEST";
+    }
+
+    return "UNKNOWN";
+}
+
+
+static void capsense_event_handler(enum capsense_event_t event, uint32_t pin_mask)
+{
+    printf("%u %s %u\n", m_time_ms, event_name(event), pin_mask);
+}
+
+
+// Classifier of the @classifier directive
+static uint32_t classify_palm(const nrf_capsense_features_t *features,
+                              uint32_t scan_mask,
+                              uint32_t pressed_mask)
+{
+    uint32_t contacts = 0;
+
+    for (unsigned int i = 0; i < CAPSENSE_NUM_BUTTONS; i++)
+    {
+        if (features->channel[i].delta_q12 > CONTACT_Q12)
+        {
+            contacts++;
+        }
+    }
+
+    return (contacts > m_classifier_max_channels) ? 0 : pressed_mask;
+}
+
+
+static int parse_tuning(const char *p)
+{
+    nrf_capsense_tuning_t tuning;
+    uint32_t margin, debounce;
+    int32_t mask;
+
+    // The mask may be given in decimal, octal or hex (0x prefix)
+    if ((sscanf(p, "@tuning %" SCNu32 " %" SCNu32 " %" SCNi32, &margin, &debounce, &mask) != 3) ||
+        (mask < 0))
+    {
+        return -1;
+    }
+
+    nrf_capsense_tuning_get(&tuning);
+    tuning.filter_margin = margin;
+    tuning.debounce_threshold = debounce;
+    tuning.channel_mask = (uint32_t)mask;
+    return (nrf_capsense_tuning_set(&tuning) == NRF_SUCCESS) ? 0 : -1;
+}
+
+
+static int parse_directive(const char *p)
+{
+    uint32_t value;
+    int32_t mask, temp;
+
+    if (strncmp(p, "@tuning ", 8) == 0)
+    {
+        return parse_tuning(p);
+    }
+    if (strncmp(p, "@calibrate", 10) == 0)
+    {
+        return (nrf_capsense_calibrate() == NRF_SUCCESS) ? 0 : -1;
+    }
+    if (sscanf(p, "@proximity %" SCNi32, &mask) == 1)
+    {
+        if ((mask < 0) || ((uint32_t)mask > ((1UL << CAPSENSE_NUM_BUTTONS) - 1)))
+        {
+            return -1;
+        }
+        m_cfg.proximity_pin_mask = (uint32_t)mask;
+        return 0;
+    }
+    if (sscanf(p, "@classifier %" SCNu32, &value) == 1)
+    {
+        m_classifier_max_channels = value;
+        m_cfg.classifier = (value > 0) ? classify_palm : 0;
+        return 0;
+    }
+    if (sscanf(p, "@temperature %" SCNd32, &temp) == 1)
+    {
+        capsense_host_temperature_set(temp);
+        return 0;
+    }
+
+    return -1;
+}
+
+
+// Parse one trace line into counts. Return 1 for a scan line, 0 for a
+// line to skip and -1 on a malformed line.
+static int parse_line(char *line, uint32_t *counts)
+{
+    char *p = line;
+
+    while ((*p == ' ') || (*p == '\t'))
+    {
+        p++;
+    }
+    if ((*p == '#') || (*p == '\n') || (*p == '\r') || (*p == '\0'))
+    {
+        return 0;
+    }
+    if (*p == '@')
+    {
+        return parse_directive(p);
+    }
+
+    for (unsigned int i = 0; i < CAPSENSE_NUM_BUTTONS; i++)
+    {
+        char *end;
+
+        counts[i] = strtoul(p, &end, 10);
+        if (end == p)
+        {
+            return -1;
+        }
+        p = end;
+        if (*p == ',')
+        {
+            p++;
+        }
+    }
+
+    return 1;
+}
+
+
+int main(int argc, char *argv[])
+{
+    static const nrf_capsense_cfg_t cfg_default = {
+        {0},
+        capsense_event_handler,
+        0,
+        0,
+        0,
+        CAPSENSE_DEFAULT_RESOURCES
+    };
+    uint32_t interval_ms = DEFAULT_INTERVAL_MS;
+    uint32_t counts[CAPSENSE_NUM_BUTTONS];
+    uint32_t scan = 0;
+    unsigned int line_number = 0;
+    char line[LINE_LENGTH];
+    const char *path = NULL;
+    FILE *trace;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if ((strcmp(argv[i], "-i") == 0) && (i + 1 < argc))
+        {
+            interval_ms = strtoul(argv[++i], NULL, 10);
+        }
+        else
+        {
+            path = argv[i];
+        }
+    }
+
+    if (path == NULL)
+    {
+        fprintf(stderr, "usage: %s [-i interval_ms] trace.csv\n", argv[0]);
+        return 2;
+    }
+
+    trace = fopen(path, "r");
+    if (trace == NULL)
+    {
+        perror(path);
+        return 2;
+    }
+
+    m_cfg = cfg_default;
+    for (unsigned int i = 0; i < CAPSENSE_NUM_BUTTONS; i++)
+    {
+        m_cfg.analog_pins[i] = i;
+    }
+    if (capsense_host_init(&m_cfg) != NRF_SUCCESS)
+    {
+        fprintf(stderr, "capsense init failed\n");
+        return 2;
+    }
+    nrf_capsense_calibrate();
+
+    while (fgets(line, sizeof(line), trace) != NULL)
+    {
+        int result;
+
+        line_number++;
+        result = parse_line(line, counts);
+        if (result < 0)
+        {
+            fprintf(stderr, "%s:%u: expected %u counts or a valid directive\n", path, line_number, CAPSENSE_NUM_BUTTONS);
+            fclose(trace);
+            return 2;
+        }
+        if (result == 0)
+        {
+            continue;
+        }
+
+        m_time_ms = scan * interval_ms;
+        if (capsense_host_pending())
+        {
+            // Calibration (or the comparator sweep) is in progress
+            capsense_host_feed(counts);
+        }
+        else if (m_cfg.proximity_pin_mask != 0)
+        {
+            nrf_capsense_proximity_sample();
+            while (capsense_host_pending())
+            {
+                capsense_host_feed(counts);
+            }
+        }
+        else
+        {
+            nrf_capsense_sample();
+            capsense_host_feed(counts);
+        }
+        scan++;
+    }
+
+    fclose(trace);
+    return 0;
+}
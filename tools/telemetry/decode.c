@@ -0,0 +1,226 @@
+/* Copyright (c) 2016 Nordic Semiconductor. All Rights Reserved.
+ *
+ * The information contained herein is property of Nordic Semiconductor ASA.
+ * Terms and conditions of usage are described in detail in NORDIC
+ * SEMICONDUCTOR STANDARD SOFTWARE LICENSE AGREEMENT.
+ *
+ * Licensees are granted free, non-transferable use of the information. NO
+ * WARRANTY of ANY KIND is provided. This heading must NOT be removed from
+ * the file.
+ *
+ */
+
+// Decode a capsense telemetry stream (see nrf_capsense_telemetry.h)
+// into CSV, one line per frame with the latest sample of every
+// channel. The output is a valid trace for tools/replay.
+//
+// Frames with a bad CRC are skipped byte by byte until the next valid
+// frame. After a sequence gap, delta frames are ignored until a key
+// frame has been received. Lines are only printed once every channel
+// has a known value. A summary is printed to stderr.
+//
+//   decode [-n <channels>] [stream]
+//
+// Without -n, the channel count is taken from the mask of the first key
+// frame. That only holds when every scan samples every channel; give
+// -n for a stream with partial masks (CAPSENSE_PARTIAL_SCAN_ENABLED).
+// The decoder stops with an error if a later frame holds a channel
+// beyond the count taken from the first key frame.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "nrf_capsense_telemetry.h"
+
+
+#define MAX_CHANNELS    8
+
+
+static uint32_t varint_get(const uint8_t **p, const uint8_t *end, int *ok)
+{
+    uint32_t value = 0;
+
+    for (unsigned int shift = 0; (*p < end) && (shift < 35); shift += 7)
+    {
+        uint8_t byte = *(*p)++;
+
+        value |= (uint32_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return value;
+        }
+    }
+
+    *ok = 0;
+    return 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+    static uint8_t stream[1 << 20];
+    uint32_t values[MAX_CHANNELS] = {0};
+    uint32_t known_mask = 0;
+    unsigned int channels = 0;
+    int channels_inferred = 0;
+    size_t length = 0;
+    size_t pos = 0;
+    int synced = 0;
+    uint8_t expected_seq = 0;
+    unsigned long frames = 0, crc_errors = 0, gaps = 0;
+    FILE *in = stdin;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if ((strcmp(argv[i], "-n") == 0) && (i + 1 < argc))
+        {
+            channels = strtoul(argv[++i], NULL, 10);
+        }
+        else if ((in = fopen(argv[i], "rb")) == NULL)
+        {
+            perror(argv[i]);
+            return 2;
+        }
+    }
+
+    if (channels > MAX_CHANNELS)
+    {
+        fprintf(stderr, "at most %u channels\n", MAX_CHANNELS);
+        return 2;
+    }
+
+    while (1)
+    {
+        size_t n = fread(&stream[length], 1, sizeof(stream) - length, in);
+
+        length += n;
+        if (n == 0)
+        {
+            break;
+        }
+
+        while (pos + 2 <= length)
+        {
+            uint8_t frame_length;
+            const uint8_t *frame;
+            const uint8_t *p;
+            const uint8_t *end;
+            uint8_t seq, flags, mask;
+            uint32_t decoded[MAX_CHANNELS];
+            int ok = 1;
+
+            if (stream[pos] != CAPSENSE_TELEMETRY_SYNC)
+            {
+                pos++;
+                continue;
+            }
+
+            frame_length = stream[pos + 1];
+            if (pos + 2 + frame_length + 1 > length)
+            {
+                // Incomplete frame, read more
+                break;
+            }
+
+            frame = &stream[pos + 1];
+            if ((frame_length < 3) ||
+                (nrf_capsense_telemetry_crc8(frame, frame_length + 1) != frame[frame_length + 1]))
+            {
+                crc_errors++;
+                pos++;
+                continue;
+            }
+
+            seq = frame[1];
+            flags = frame[2];
+            mask = frame[3];
+            p = &frame[4];
+            end = &frame[frame_length + 1];
+
+            for (unsigned int i = 0; i < MAX_CHANNELS; i++)
+            {
+                if (mask & (1 << i))
+                {
+                    decoded[i] = varint_get(&p, end, &ok);
+                }
+            }
+            if (!ok || (p != end))
+            {
+                crc_errors++;
+                pos++;
+                continue;
+            }
+            pos += 2 + frame_length + 1;
+            frames++;
+
+            if (synced && (seq != expected_seq))
+            {
+                gaps++;
+                synced = 0;
+                printf("# gap: %u frames lost\n", (uint8_t)(seq - expected_seq));
+            }
+            expected_seq = seq + 1;
+
+            if (channels_inferred && (mask >> channels))
+            {
+                fprintf(stderr, "frame %u holds a channel beyond the %u of the first key frame; "
+                        "give the channel count with -n\n", seq, channels);
+                return 2;
+            }
+
+            if (flags & CAPSENSE_TELEMETRY_FLAG_KEY)
+            {
+                for (unsigned int i = 0; i < MAX_CHANNELS; i++)
+                {
+                    if (mask & (1 << i))
+                    {
+                        values[i] = decoded[i];
+                    }
+                }
+                known_mask = synced ? (known_mask | mask) : mask;
+                synced = 1;
+                if (channels == 0)
+                {
+                    while ((channels < MAX_CHANNELS) && (mask >> channels))
+                    {
+                        channels++;
+                    }
+                    channels_inferred = 1;
+                }
+            }
+            else if (synced)
+            {
+                for (unsigned int i = 0; i < MAX_CHANNELS; i++)
+                {
+                    if (mask & (1 << i))
+                    {
+                        // Undo zigzag
+                        int32_t delta = (int32_t)(decoded[i] >> 1) ^ -(int32_t)(decoded[i] & 1);
+                        values[i] += delta;
+                    }
+                }
+            }
+            else
+            {
+                continue;
+            }
+
+            if ((channels > 0) && ((known_mask & ((1u << channels) - 1)) == (1u << channels) - 1))
+            {
+                for (unsigned int i = 0; i < channels; i++)
+                {
+                    printf(i ? ",%u" : "%u", values[i]);
+                }
+                printf("\n");
+            }
+        }
+
+        // Keep the unprocessed tail
+        memmove(stream, &stream[pos], length - pos);
+        length -= pos;
+        pos = 0;
+    }
+
+    fprintf(stderr, "%lu frames, %lu bad frames, %lu gaps\n", frames, crc_errors, gaps);
+    return 0;
+}
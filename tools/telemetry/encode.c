@@ -0,0 +1,104 @@
+/* Copyright (c) 2016 Nordic Semiconductor. All Rights Reserved.
+ *
+ * The information contained herein is property of Nordic Semiconductor ASA.
+ * Terms and conditions of usage are described in detail in NORDIC
+ * SEMICONDUCTOR STANDARD SOFTWARE LICENSE AGREEMENT.
+ *
+ * Licensees are granted free, non-transferable use of the information. NO
+ * WARRANTY of ANY KIND is provided. This heading must NOT be removed from
+ * the file.
+ *
+ */
+
+// Encode a replay trace (see tools/replay) into a telemetry stream
+// with the target encoder, one frame per scan line. Used to check the
+// decoder, and to produce test streams. Each scan line holds
+// CAPSENSE_NUM_BUTTONS counts.
+//
+//   encode [-p] [-d <frame>] [trace]
+//
+//   -p          Emulate partial scan: every fourth frame holds every
+//               channel, the others hold channel
+//               <frame> % CAPSENSE_NUM_BUTTONS only.
+//   -d <frame>  Leave frame number <frame> out of the stream, as if it
+//               was lost on the link.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "nrf_capsense_telemetry.h"
+#include "nrf_capsense_cfg.h"
+
+
+int main(int argc, char *argv[])
+{
+    char line[256];
+    uint8_t frame[CAPSENSE_TELEMETRY_MAX_FRAME];
+    uint32_t samples[CAPSENSE_NUM_BUTTONS];
+    unsigned long frame_number = 0;
+    long drop = -1;
+    int partial = 0;
+    FILE *in = stdin;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-p") == 0)
+        {
+            partial = 1;
+        }
+        else if ((strcmp(argv[i], "-d") == 0) && (i + 1 < argc))
+        {
+            drop = strtol(argv[++i], NULL, 10);
+        }
+        else if ((in = fopen(argv[i], "r")) == NULL)
+        {
+            perror(argv[i]);
+            return 2;
+        }
+    }
+
+    nrf_capsense_telemetry_init();
+
+    while (fgets(line, sizeof(line), in) != NULL)
+    {
+        char *p = line;
+        unsigned int i;
+        uint32_t mask;
+        uint32_t length;
+
+        if ((*p == '#') || (*p == '@') || (*p == '\n') || (*p == '\r'))
+        {
+            continue;
+        }
+
+        for (i = 0; i < CAPSENSE_NUM_BUTTONS; i++)
+        {
+            char *end;
+
+            samples[i] = strtoul(p, &end, 10);
+            if (end == p)
+            {
+                break;
+            }
+            p = (*end == ',') ? end + 1 : end;
+        }
+        if (i < CAPSENSE_NUM_BUTTONS)
+        {
+            continue;
+        }
+
+        mask = (1UL << CAPSENSE_NUM_BUTTONS) - 1;
+        if (partial && ((frame_number % 4) != 3))
+        {
+            mask = 1UL << (frame_number % CAPSENSE_NUM_BUTTONS);
+        }
+        length = nrf_capsense_telemetry_encode(samples, mask, frame);
+        if ((long)frame_number != drop)
+        {
+            fwrite(frame, 1, length, stdout);
+        }
+        frame_number++;
+    }
+
+    return 0;
+}